@@ -0,0 +1,130 @@
+// Throughput of the byte buffers, with one producer and one consumer thread.
+//
+// Each run pushes a fixed number of messages of a given size through the buffer, either with the plain
+// write/read interface or with records, and reports the number of messages per second.
+
+#include <chrono>
+#include <cstring>
+#include <latch>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <hage/logging/mirrored_ring_buffer.hpp>
+#include <hage/logging/ring_buffer.hpp>
+
+namespace {
+
+constexpr std::size_t MESSAGES = 1'000'000;
+constexpr std::size_t BUFFER_SIZE = 1 << 16;
+
+enum class Mode
+{
+  Stream,
+  Records
+};
+
+template<typename Buffer>
+double
+run(Buffer& buffer, const Mode mode, const std::size_t messageSize)
+{
+  std::latch ready(3);
+
+  std::thread producer([&]() {
+    std::vector<std::byte> msg(messageSize, std::byte{ 42 });
+    auto writer = buffer.writer();
+
+    ready.arrive_and_wait();
+    for (std::size_t i = 0; i < MESSAGES;) {
+      if (mode == Mode::Stream) {
+        if (!writer.write(msg)) {
+          std::this_thread::yield();
+          continue;
+        }
+
+        writer.commit();
+      } else {
+        const auto dst = writer.reserve(messageSize);
+        if (dst.empty()) {
+          std::this_thread::yield();
+          continue;
+        }
+
+        std::memcpy(dst.data(), msg.data(), messageSize);
+        writer.commit(messageSize);
+      }
+      i++;
+    }
+  });
+
+  std::thread consumer([&]() {
+    std::vector<std::byte> msg(messageSize);
+    auto reader = buffer.reader();
+
+    ready.arrive_and_wait();
+    for (std::size_t i = 0; i < MESSAGES;) {
+      if (mode == Mode::Stream) {
+        if (!reader.read(msg)) {
+          std::this_thread::yield();
+          continue;
+        }
+      } else {
+        const auto record = reader.read_record();
+        if (record.empty()) {
+          std::this_thread::yield();
+          continue;
+        }
+
+        std::memcpy(msg.data(), record.data(), record.size());
+      }
+
+      reader.commit();
+      i++;
+    }
+  });
+
+  ready.arrive_and_wait();
+  const auto start = std::chrono::steady_clock::now();
+  producer.join();
+  consumer.join();
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+  return static_cast<double>(MESSAGES) / elapsed.count();
+}
+
+template<typename Buffer>
+void
+report(const std::string_view name, Buffer& buffer)
+{
+  for (const auto messageSize : { 8, 32, 128, 512 }) {
+    const auto stream = run(buffer, Mode::Stream, messageSize);
+    const auto records = run(buffer, Mode::Records, messageSize);
+    fmt::print("{:<20} {:>5} B {:>12.2f} Mmsg/s {:>12.2f} Mmsg/s\n",
+               name,
+               messageSize,
+               stream / 1e6,
+               records / 1e6);
+  }
+}
+
+} // namespace
+
+int
+main()
+{
+  fmt::print("{:<20} {:>7} {:>19} {:>19}\n", "buffer", "size", "stream", "records");
+
+  // These are big, so we keep them off the stack.
+  const auto ringBuffer = std::make_unique<hage::RingBuffer<BUFFER_SIZE>>();
+  report("RingBuffer", *ringBuffer);
+
+#if HAGE_HAS_MIRRORED_RING_BUFFER
+  hage::MirroredRingBuffer mirroredRingBuffer(BUFFER_SIZE);
+  report("MirroredRingBuffer", mirroredRingBuffer);
+#endif
+
+  return 0;
+}
@@ -0,0 +1,233 @@
+// Throughput of a Logger, with one producer and one consumer thread pinned to separate cores.
+//
+// The producer logs a fixed number of lines while the consumer reads them into a NullSink, so what is measured is the
+// handoff between the two threads rather than the formatting. Running it under `perf stat -e cache-misses` or
+// `perf c2c record` shows how much the two sides contend for shared cache lines.
+//
+// Before that, the two ways of tracking how much of the buffer is in use are run on their own, over the same RingBuffer
+// records. The shared counter is what the logger used to do, one count of free bytes that the producer takes from and
+// the consumer gives back to with a read-modify-write for every message. The split counters are what it does now, a
+// written and a read count that each only the one side stores to.
+//
+// Pinning needs at least two CPUs. With fewer the threads are left where the scheduler puts them, and the numbers don't
+// say much about cross-core traffic.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <latch>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+#include <fmt/chrono.h>
+#include <fmt/core.h>
+
+#include <hage/core/misc.hpp>
+#include <hage/logging/logger.hpp>
+#include <hage/logging/ring_buffer.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+constexpr std::size_t MESSAGES = 5'000'000;
+constexpr std::size_t BUFFER_SIZE = 1 << 16;
+
+// About the size of a short log line with a couple of arguments.
+constexpr std::size_t MESSAGE_SIZE = 32;
+
+constexpr unsigned PRODUCER_CPU = 0;
+constexpr unsigned CONSUMER_CPU = 1;
+
+bool
+can_pin()
+{
+#if defined(__linux__)
+  return 2 <= std::thread::hardware_concurrency();
+#else
+  return false;
+#endif
+}
+
+// Moves the calling thread onto `cpu`, if we can pin at all.
+void
+pin_to_cpu(const unsigned cpu)
+{
+#if defined(__linux__)
+  if (!can_pin())
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    fmt::print(stderr, "Unable to pin a thread to CPU {}\n", cpu);
+#else
+  static_cast<void>(cpu);
+#endif
+}
+
+enum class Counter
+{
+  Shared,
+  Split
+};
+
+struct Counters
+{
+  alignas(hage::detail::destructive_interference_size) std::atomic<std::size_t> available{ BUFFER_SIZE };
+  alignas(hage::detail::destructive_interference_size) std::atomic<std::size_t> written{ 0 };
+  alignas(hage::detail::destructive_interference_size) std::atomic<std::size_t> read{ 0 };
+};
+
+// Moves MESSAGES records through the buffer, tracking how much is in use with the given kind of counter.
+template<Counter C, typename Buffer>
+double
+run_counter(Buffer& buffer)
+{
+  Counters counters;
+  std::latch ready(3);
+
+  std::thread producer([&]() {
+    pin_to_cpu(PRODUCER_CPU);
+    auto writer = buffer.writer();
+
+    ready.arrive_and_wait();
+    for (std::size_t i = 0; i < MESSAGES;) {
+      const auto dst = writer.reserve(MESSAGE_SIZE);
+      if (dst.empty()) {
+        // The logger only looks at the consumer's count when a message doesn't fit.
+        if constexpr (C == Counter::Split)
+          static_cast<void>(counters.read.load(std::memory_order::acquire));
+        std::this_thread::yield();
+        continue;
+      }
+
+      std::memset(dst.data(), 42, MESSAGE_SIZE);
+      writer.commit(MESSAGE_SIZE);
+
+      if constexpr (C == Counter::Shared) {
+        counters.available.fetch_sub(MESSAGE_SIZE, std::memory_order::acq_rel);
+      } else {
+        const auto written = counters.written.load(std::memory_order::relaxed);
+        counters.written.store(written + MESSAGE_SIZE, std::memory_order::release);
+      }
+      i++;
+    }
+  });
+
+  std::thread consumer([&]() {
+    pin_to_cpu(CONSUMER_CPU);
+    auto reader = buffer.reader();
+
+    ready.arrive_and_wait();
+    for (std::size_t i = 0; i < MESSAGES;) {
+      std::size_t used;
+      if constexpr (C == Counter::Shared)
+        used = BUFFER_SIZE - counters.available.load(std::memory_order::acquire);
+      else
+        used = counters.written.load(std::memory_order::acquire) - counters.read.load(std::memory_order::relaxed);
+
+      if (used == 0) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      // Everything the count covers has been committed, so we read it all before handing the space back at once.
+      std::byte msg[MESSAGE_SIZE];
+      for (std::size_t n = 0; n < used / MESSAGE_SIZE; n++) {
+        const auto record = reader.read_record();
+        std::memcpy(msg, record.data(), record.size());
+      }
+      reader.commit();
+      i += used / MESSAGE_SIZE;
+
+      if constexpr (C == Counter::Shared) {
+        counters.available.fetch_add(used, std::memory_order::acq_rel);
+      } else {
+        const auto read = counters.read.load(std::memory_order::relaxed);
+        counters.read.store(read + used, std::memory_order::release);
+      }
+    }
+  });
+
+  ready.arrive_and_wait();
+  const auto start = std::chrono::steady_clock::now();
+  producer.join();
+  consumer.join();
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+  return static_cast<double>(MESSAGES) / elapsed.count();
+}
+
+template<typename Buffer>
+void
+report(const std::string_view name, Buffer& buffer, const std::size_t batchSize)
+{
+  hage::NullSink sink;
+  hage::Logger logger(&buffer, &sink);
+  logger.set_min_log_level(hage::LogLevel::Trace);
+
+  std::latch ready(3);
+
+  std::thread producer([&]() {
+    pin_to_cpu(PRODUCER_CPU);
+    ready.arrive_and_wait();
+    for (std::size_t i = 0; i < MESSAGES; i++)
+      logger.info("message {} of {}", i, MESSAGES);
+  });
+
+  std::thread consumer([&]() {
+    pin_to_cpu(CONSUMER_CPU);
+    ready.arrive_and_wait();
+    for (std::size_t read = 0; read < MESSAGES;)
+      read += logger.read_logs(batchSize);
+  });
+
+  ready.arrive_and_wait();
+  const auto start = std::chrono::steady_clock::now();
+  producer.join();
+  consumer.join();
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+  const auto stats = logger.stats();
+  fmt::print("{:<20} {:>6} {:>12.2f} Mmsg/s {:>10} {:>12} {:>10} B\n",
+             name,
+             batchSize,
+             static_cast<double>(MESSAGES) / elapsed.count() / 1e6,
+             stats.producerWaits,
+             std::chrono::duration_cast<std::chrono::microseconds>(stats.producerWaitTime),
+             stats.peakOccupancy);
+}
+
+} // namespace
+
+int
+main()
+{
+  if (can_pin())
+    fmt::print("Producer on CPU {}, consumer on CPU {}\n\n", PRODUCER_CPU, CONSUMER_CPU);
+  else
+    fmt::print("Fewer than two CPUs, or no way to pin, so the threads are not pinned\n\n");
+
+  // These are big, so we keep them off the stack.
+  const auto ringBuffer = std::make_unique<hage::RingBuffer<BUFFER_SIZE>>();
+
+  fmt::print("{:<20} {:>19}\n", "counter", "throughput");
+  fmt::print("{:<20} {:>12.2f} Mmsg/s\n", "shared", run_counter<Counter::Shared>(*ringBuffer) / 1e6);
+  fmt::print("{:<20} {:>12.2f} Mmsg/s\n\n", "split", run_counter<Counter::Split>(*ringBuffer) / 1e6);
+
+  fmt::print("{:<20} {:>6} {:>19} {:>10} {:>12} {:>12}\n", "buffer", "batch", "throughput", "waits", "wait time", "peak");
+
+  for (const auto batchSize : { 1, 16, 256 }) {
+    const auto loggerBuffer = std::make_unique<hage::RingBuffer<BUFFER_SIZE>>();
+    report("RingBuffer", *loggerBuffer, batchSize);
+  }
+
+  return 0;
+}
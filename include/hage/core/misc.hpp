@@ -2,6 +2,10 @@
 
 #include <array>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
 namespace hage {
 namespace detail {
 #ifdef __cpp_lib_hardware_interference_size
@@ -29,6 +33,19 @@ byte_array(T... a)
 template<typename...>
 constexpr bool dependent_false = false;
 
+// Tells the cpu that we are in a spin loop, so it can save power and let a sibling hyper thread run.
+inline void
+cpu_relax() noexcept
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
 #if !defined(NDEBUG)
 #define HAGE_DEBUG true
 inline constexpr bool debug_mode = true;
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "logging/binary_file_sink.hpp"
+#include "logging/clock.hpp"
+#include "logging/log_macros.hpp"
 #include "logging/logger.hpp"
+#include "logging/multi_producer_logger.hpp"
+#include "logging/raw_sink.hpp"
 #include "logging/ring_buffer.hpp"
 #include "logging/serializers.hpp"
 #include "logging/sink.hpp"
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "file_sink.hpp"
+#include "sink.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <fmt/os.h>
+
+namespace hage {
+
+/**
+ * A file sink that never waits for the disk while it has a free buffer. Lines are formatted into one of a small pool of
+ * buffers, and when the flush policy says so, the buffer is handed off to be written while the next one is filled.
+ * Only when every buffer is waiting to be written does the sink block.
+ *
+ * On Linux the writes are submitted through io_uring. Where that isn't available, or is disabled in the config, a
+ * helper thread does them with pwrite instead.
+ */
+class AsyncFileSink final : public Sink
+{
+public:
+  struct Config
+  {
+    // Each buffer is submitted when full, like FileSink. The buffer size is per buffer.
+    FileFlushPolicy policy{};
+    std::size_t bufferCount{ 4 };
+    bool useIoUring{ true };
+  };
+
+  // Can be read from any thread.
+  struct Stats
+  {
+    std::size_t inFlight;
+    std::uint64_t writesCompleted;
+    std::chrono::nanoseconds totalWriteLatency;
+    std::chrono::nanoseconds maxWriteLatency;
+  };
+
+  explicit AsyncFileSink(const std::filesystem::path& path) : AsyncFileSink(path, Config{}) {}
+  AsyncFileSink(const std::filesystem::path& path,
+                Config config,
+                int flags = fmt::file::WRONLY | fmt::file::CREATE | fmt::file::TRUNC);
+  ~AsyncFileSink() override;
+
+  void receive(LogLevel level, const timestamp_type& ts, std::string_view line) override;
+  void receive_batch(std::span<const Record> records) override;
+
+  // Submits the current buffer, if its oldest line has waited for the max delay.
+  void on_idle(const timestamp_type& now) override;
+
+  // Submits what is buffered, and waits for every write to complete.
+  void flush();
+
+  // All the bytes the sink has been given, including the ones not yet written.
+  [[nodiscard]] std::size_t bytes_written() const { return m_bytesWritten; }
+
+  [[nodiscard]] Stats stats() const;
+
+  void set_pattern(LinePattern pattern) { m_pattern = std::move(pattern); }
+  void set_timestamp_precision(const TimestampPrecision precision) { m_pattern.set_timestamp_precision(precision); }
+
+  // If the writes go through io_uring, rather than the helper thread.
+  [[nodiscard]] bool uses_io_uring() const;
+
+  class Backend;
+
+private:
+  void submit_current();
+  void reap(bool wait);
+
+  Config m_config;
+  fmt::file m_file;
+
+  std::vector<fmt::memory_buffer> m_buffers;
+  std::vector<std::chrono::steady_clock::time_point> m_submitted;
+  std::vector<std::size_t> m_free;
+  std::vector<std::size_t> m_completed;
+  std::size_t m_current;
+
+  std::uint64_t m_offset{ 0 };
+  std::size_t m_bytesWritten{ 0 };
+  timestamp_type m_oldestBuffered{};
+  LinePattern m_pattern;
+
+  std::atomic<std::size_t> m_inFlight{ 0 };
+  std::atomic<std::uint64_t> m_writesCompleted{ 0 };
+  std::atomic<std::int64_t> m_totalLatency{ 0 };
+  std::atomic<std::int64_t> m_maxLatency{ 0 };
+
+  // Last, so it is gone before the buffers it might be writing from.
+  std::unique_ptr<Backend> m_backend;
+};
+
+} // namespace hage
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "raw_sink.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/os.h>
+
+namespace hage {
+
+/**
+ * Writes log lines without formatting them, so all the consumer does is copy the arguments. The first time a log
+ * statement is seen, an entry with its level, location, format string and argument types is written, and after that
+ * each line is just the id of that entry, the timestamp and the arguments. Use decode_binary_log or the hage_logdecode
+ * tool to turn the file into text.
+ *
+ * Lines with arguments that aren't describable are formatted by the logger, and stored as a single string. The file is
+ * in the byte order of the machine that wrote it.
+ */
+class BinaryFileSink final : public RawSink
+{
+public:
+  static constexpr std::string_view magic = "HAGEBLOG";
+  static constexpr std::uint32_t version = 1;
+
+  explicit BinaryFileSink(const std::filesystem::path& path);
+  ~BinaryFileSink() override;
+
+  void receive(LogLevel level, const timestamp_type& ts, std::string_view line) override;
+  void receive_raw(const RawRecord& record) override;
+
+  // Writes out what is buffered. This happens by itself when the buffer fills up, and when the sink is destroyed.
+  void flush();
+
+  [[nodiscard]] constexpr std::size_t bytes_written() const { return m_bytesWritten; }
+
+private:
+  // Runtime format strings share a site, so the format is part of what identifies a statement.
+  struct SiteKey
+  {
+    const LogSiteInfo* site;
+    const char* format;
+
+    bool operator==(const SiteKey&) const = default;
+  };
+
+  struct SiteKeyHash
+  {
+    std::size_t operator()(const SiteKey& key) const
+    {
+      return std::hash<const void*>{}(key.site) ^ (std::hash<const void*>{}(key.format) << 1);
+    }
+  };
+
+  std::uint32_t site_id(const RawRecord& record);
+
+  fmt::file m_file;
+  std::vector<std::byte> m_buffer;
+  std::vector<std::byte> m_line;
+  std::unordered_map<SiteKey, std::uint32_t, SiteKeyHash> m_siteIds;
+  std::size_t m_bytesWritten{ 0 };
+};
+
+/**
+ * Reads a file written by a BinaryFileSink, and passes the formatted lines to the sink in batches. Throws a
+ * std::runtime_error if the file can't be read, or isn't a binary log.
+ */
+void
+decode_binary_log(const std::filesystem::path& path, Sink& sink);
+
+} // namespace hage
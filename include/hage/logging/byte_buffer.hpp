@@ -1,7 +1,10 @@
 #pragma once
 
+#include <concepts>
+#include <cstring>
 #include <memory>
 #include <span>
+#include <vector>
 
 namespace hage {
 
@@ -35,4 +38,193 @@ public:
   [[nodiscard]] virtual std::size_t capacity() = 0;
 };
 
-} // namespace hage
\ No newline at end of file
+/**
+ * Anything the serializers can write bytes to. ByteBuffer::Writer is the obvious one, but the concrete writers of
+ * the buffers also fit, which lets the calls be resolved at compile time.
+ */
+template<typename W>
+concept ByteWriter = requires(W& w, std::span<const std::byte> src) {
+  { w.write(src) } -> std::same_as<bool>;
+};
+
+/**
+ * Anything the serializers can read bytes from.
+ */
+template<typename R>
+concept ByteReader = requires(R& r, std::span<std::byte> dst) {
+  { r.read(dst) } -> std::same_as<bool>;
+};
+
+/**
+ * A ByteReader that can also hand out the next bytes as a view, instead of copying them. The view stays valid at least
+ * until the current message has been decoded.
+ */
+template<typename R>
+concept ViewableByteReader = ByteReader<R> && requires(R& r, std::size_t n, std::span<const std::byte>& dst) {
+  { r.read_view(n, dst) } -> std::same_as<bool>;
+};
+
+/**
+ * A ByteBuffer that also hands out its concrete reader and writer by value. This allows the logger to keep them on the
+ * stack and to call them without going through the vtable.
+ */
+template<typename B>
+concept StaticByteBuffer = std::derived_from<B, ByteBuffer> && requires(B& b) {
+  { b.reader() } -> std::same_as<typename B::Reader>;
+  { b.writer() } -> std::same_as<typename B::Writer>;
+};
+
+/**
+ * A StaticByteBuffer which can also hand out contiguous regions of itself. A whole message is reserved with
+ * `reserve(n)`, serialized in place and published with `commit(used)`. On the other end `read_record()` returns the
+ * next committed message as a single span.
+ *
+ * The record interface and the plain read/write interface should not be mixed on the same buffer.
+ */
+template<typename B>
+concept ReservableByteBuffer =
+  StaticByteBuffer<B> && requires(B& b, typename B::Reader& r, typename B::Writer& w, std::size_t n) {
+    { b.max_reservation() } -> std::same_as<std::size_t>;
+    { w.reserve(n) } -> std::same_as<std::span<std::byte>>;
+    { w.commit(n) } -> std::same_as<bool>;
+    { r.read_record() } -> std::same_as<std::span<const std::byte>>;
+  };
+
+/**
+ * A writer into a fixed region of memory, typically a reservation in a ReservableByteBuffer.
+ */
+class SpanWriter final
+{
+public:
+  explicit SpanWriter(const std::span<std::byte> dst) : m_dst{ dst } {}
+
+  bool write(const std::span<const std::byte> src)
+  {
+    if (m_dst.size() - m_bytesWritten < src.size_bytes())
+      return false;
+
+    std::memcpy(m_dst.data() + m_bytesWritten, src.data(), src.size_bytes());
+    m_bytesWritten += src.size_bytes();
+    return true;
+  }
+
+  [[nodiscard]] std::size_t bytes_written() const { return m_bytesWritten; }
+
+private:
+  std::span<std::byte> m_dst;
+  std::size_t m_bytesWritten{ 0 };
+};
+
+/**
+ * A writer into a region that the caller has already made sure is large enough for everything written to it, so it
+ * doesn't check anything itself. Used by the logger when it knows the size of a message before writing it.
+ */
+class UncheckedSpanWriter final
+{
+public:
+  explicit UncheckedSpanWriter(std::byte* dst) : m_dst{ dst } {}
+
+  bool write(const std::span<const std::byte> src)
+  {
+    std::memcpy(m_dst + m_bytesWritten, src.data(), src.size_bytes());
+    m_bytesWritten += src.size_bytes();
+    return true;
+  }
+
+  [[nodiscard]] std::size_t bytes_written() const { return m_bytesWritten; }
+
+private:
+  std::byte* m_dst;
+  std::size_t m_bytesWritten{ 0 };
+};
+
+/**
+ * A writer that appends to a vector, growing it as needed. Used where the size of what is written isn't known up front.
+ */
+class VectorWriter final
+{
+public:
+  explicit VectorWriter(std::vector<std::byte>& dst) : m_dst{ dst } {}
+
+  bool write(const std::span<const std::byte> src)
+  {
+    m_dst.insert(m_dst.end(), src.begin(), src.end());
+    return true;
+  }
+
+private:
+  std::vector<std::byte>& m_dst;
+};
+
+/**
+ * A reader from a fixed region of memory, typically a record handed out by a ReservableByteBuffer.
+ */
+class SpanReader final
+{
+public:
+  explicit SpanReader(const std::span<const std::byte> src) : m_src{ src } {}
+
+  bool read(const std::span<std::byte> dst)
+  {
+    if (m_src.size() - m_bytesRead < dst.size_bytes())
+      return false;
+
+    std::memcpy(dst.data(), m_src.data() + m_bytesRead, dst.size_bytes());
+    m_bytesRead += dst.size_bytes();
+    return true;
+  }
+
+  bool read_view(const std::size_t size, std::span<const std::byte>& dst)
+  {
+    if (m_src.size() - m_bytesRead < size)
+      return false;
+
+    dst = m_src.subspan(m_bytesRead, size);
+    m_bytesRead += size;
+    return true;
+  }
+
+  [[nodiscard]] std::size_t bytes_read() const { return m_bytesRead; }
+
+private:
+  std::span<const std::byte> m_src;
+  std::size_t m_bytesRead{ 0 };
+};
+
+/**
+ * Gives views to a reader that can only copy, by copying into a fixed arena. The arena is never reallocated, so all the
+ * views handed out stay valid for the lifetime of the ArenaReader.
+ */
+template<ByteReader Reader>
+class ArenaReader final
+{
+public:
+  ArenaReader(Reader& reader, const std::span<std::byte> arena)
+    : m_reader{ reader }
+    , m_arena{ arena }
+  {
+  }
+
+  bool read(const std::span<std::byte> dst) { return m_reader.read(dst); }
+
+  bool read_view(const std::size_t size, std::span<const std::byte>& dst)
+  {
+    if (m_arena.size() - m_arenaUsed < size)
+      return false;
+
+    const auto region = m_arena.subspan(m_arenaUsed, size);
+    if (!m_reader.read(region))
+      return false;
+
+    m_arenaUsed += size;
+    dst = region;
+    return true;
+  }
+
+private:
+  Reader& m_reader;
+  std::span<std::byte> m_arena;
+  std::size_t m_arenaUsed{ 0 };
+};
+
+} // namespace hage
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "sink.hpp"
+
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+namespace hage {
+
+/**
+ * A clock the producers use to timestamp their log lines. `now` is called on the producer for every line, so it has to
+ * be cheap, while `to_timestamp` is called by the consumer to turn the raw ticks into a time point for the sink.
+ */
+template<typename C>
+concept LogClock = requires(const std::uint64_t ticks) {
+  { C::now() } noexcept -> std::same_as<std::uint64_t>;
+  { C::to_timestamp(ticks) } -> std::same_as<Sink::timestamp_type>;
+};
+
+/**
+ * Uses std::chrono::system_clock directly, so there is no conversion, but it is the most expensive to read.
+ */
+struct SystemClock
+{
+  static std::uint64_t now() noexcept
+  {
+    return static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+  }
+
+  static Sink::timestamp_type to_timestamp(const std::uint64_t ticks)
+  {
+    using duration = Sink::timestamp_type::duration;
+    return Sink::timestamp_type(duration(static_cast<duration::rep>(ticks)));
+  }
+};
+
+/**
+ * Reads CLOCK_MONOTONIC_COARSE, which is about as cheap as a clock can be, but only has the resolution of the kernel
+ * tick, typically 1 to 4 ms. The ticks are mapped to the system clock with an offset measured the first time they are
+ * converted. On platforms without a coarse clock, this falls back to std::chrono::steady_clock.
+ */
+struct CoarseClock
+{
+  static std::uint64_t now() noexcept
+  {
+#if defined(__linux__)
+    timespec ts{};
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<std::uint64_t>(ts.tv_nsec);
+#else
+    return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count());
+#endif
+  }
+
+  static Sink::timestamp_type to_timestamp(std::uint64_t ticks);
+};
+
+/**
+ * Reads the cpu's time stamp counter, which costs a handful of cycles and doesn't enter the kernel. The rate of the
+ * counter is measured against the steady clock once, and after that the ticks are mapped to the system clock with it.
+ *
+ * This assumes the cpu has an invariant TSC, which is synchronized between cores, as on any recent x86 cpu. On other
+ * architectures this falls back to std::chrono::steady_clock.
+ */
+struct TscClock
+{
+  static std::uint64_t now() noexcept
+  {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count());
+#endif
+  }
+
+  static Sink::timestamp_type to_timestamp(std::uint64_t ticks);
+
+  /**
+   * Measures the rate of the counter. This sleeps for a few milliseconds, and is otherwise done by the first call to
+   * to_timestamp, so it can be called at startup to keep it off the consumer.
+   */
+  static void calibrate();
+};
+
+static_assert(LogClock<SystemClock>);
+static_assert(LogClock<CoarseClock>);
+static_assert(LogClock<TscClock>);
+
+} // namespace hage
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "sink.hpp"
+#include "line_pattern.hpp"
+
+#include <fmt/format.h>
+
+#include <utility>
 
 namespace hage {
 
@@ -8,6 +13,17 @@ class ConsoleSink final : public Sink
 {
 public:
   void receive(const LogLevel level, const timestamp_type& ts, const std::string_view line) override;
+
+  // Formats the whole batch before writing it to stdout in one go.
+  void receive_batch(std::span<const Record> records) override;
+
+  // The levels are colored, unless the pattern given here says otherwise.
+  void set_pattern(LinePattern pattern) { m_pattern = std::move(pattern); }
+  void set_timestamp_precision(const TimestampPrecision precision) { m_pattern.set_timestamp_precision(precision); }
+
+private:
+  fmt::memory_buffer m_buffer;
+  LinePattern m_pattern{ LinePattern::default_pattern, LinePattern::LevelStyle::Colored };
 };
 
 } // namespace hage
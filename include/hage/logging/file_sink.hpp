@@ -1,27 +1,83 @@
 #pragma once
 #include "sink.hpp"
+#include "line_pattern.hpp"
+#include <chrono>
+#include <cstddef>
 #include <filesystem>
+#include <utility>
 
+#include <fmt/format.h>
 #include <fmt/os.h>
 
 namespace hage {
 
+/**
+ * When a FileSink writes out what it has buffered. Whichever is hit first causes a flush.
+ */
+struct FileFlushPolicy
+{
+  // The size of the buffer, which is written out once it is full.
+  std::size_t bufferSize{ 1024 * 1024 };
+
+  // Lines are not kept in the buffer for longer than this, going by their timestamps. Zero writes every batch. This is
+  // checked as lines arrive, and when the consumer is idle, see Sink::on_idle.
+  std::chrono::milliseconds maxDelay{ 1000 };
+
+  // Lines at this level or above are written out straight away, along with everything before them.
+  LogLevel flushLevel{ LogLevel::Error };
+};
+
 class FileSink final : public Sink
 {
 public:
   explicit FileSink(const std::filesystem::path& path,
                     const int flags = fmt::file::WRONLY | fmt::file::CREATE | fmt::file::TRUNC)
-    : m_out(fmt::output_file(path.string(), flags))
+    : FileSink(path, FileFlushPolicy{}, flags)
   {
   }
 
+  FileSink(const std::filesystem::path& path,
+           FileFlushPolicy policy,
+           int flags = fmt::file::WRONLY | fmt::file::CREATE | fmt::file::TRUNC);
+
+  // Writes to a file that is already open.
+  explicit FileSink(fmt::file file, FileFlushPolicy policy = {});
+
+  FileSink(FileSink&&) = default;
+  ~FileSink() override;
+
   void receive(LogLevel, const timestamp_type&, std::string_view) override;
+
+  // Formats the whole batch into the buffer, and writes it out if the flush policy says so.
+  void receive_batch(std::span<const Record> records) override;
+
+  /**
+   * Like receive_batch, but stops after the first line that takes bytes_written to `maxBytes` or past it. Returns the
+   * number of lines taken, which is at least one unless `records` is empty.
+   */
+  std::size_t receive_until(std::span<const Record> records, std::size_t maxBytes);
+
+  // Writes out the buffer, if its oldest line has waited for the max delay.
+  void on_idle(const timestamp_type& now) override;
   void flush();
 
+  // Writes out the buffer, and carries on in the next file. Returns the previous one, and bytes_written starts over.
+  fmt::file swap_file(fmt::file next);
+
+  void set_pattern(LinePattern pattern) { m_pattern = std::move(pattern); }
+  void set_timestamp_precision(const TimestampPrecision precision) { m_pattern.set_timestamp_precision(precision); }
+
+  // All the bytes the sink has been given for this file, including the ones still in the buffer.
   [[nodiscard]] constexpr std::size_t bytes_written() const { return m_bytesWritten; };
 
 private:
-  fmt::ostream m_out;
+  fmt::file m_file;
+  FileFlushPolicy m_policy;
   std::size_t m_bytesWritten{ 0 };
+  fmt::memory_buffer m_buffer;
+  LinePattern m_pattern;
+
+  // The timestamp of the oldest line in the buffer.
+  timestamp_type m_oldestBuffered{};
 };
-} // namespace hage
\ No newline at end of file
+} // namespace hage
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "sink.hpp"
+#include "timestamp_cache.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace hage {
+
+/**
+ * The layout of a log line in the text sinks. The pattern is parsed once, into a flat list of operations, so formatting
+ * a line is a walk over that list with no parsing. The fields are:
+ *
+ *   {time}      The timestamp, in UTC. {time:s}, {time:ms}, {time:us} and {time:ns} pick the precision.
+ *   {level}     The level, padded to 5 characters.
+ *   {thread}    The number of the thread that logged the line, see this_thread_log_id.
+ *   {file}      The source file, {line} the line and {function} the function, when the line came from HAGE_LOG.
+ *   {message}   The formatted line itself.
+ *
+ * Anything else is copied as it is, and "{{" and "}}" are written as single braces.
+ */
+class LinePattern
+{
+public:
+  static constexpr std::string_view default_pattern = "[{time}] [{level}]: {message}\n";
+
+  enum class LevelStyle : std::uint8_t
+  {
+    Plain,
+    // The level names are colored with ANSI escapes, for terminals.
+    Colored
+  };
+
+  // Throws a std::runtime_error if the pattern has a field we don't know, or an unmatched brace.
+  explicit LinePattern(std::string_view pattern = default_pattern, LevelStyle style = LevelStyle::Plain);
+
+  void format(fmt::memory_buffer& out, const Sink::Record& record);
+
+  void set_timestamp_precision(const TimestampPrecision precision) { m_timestamps.set_precision(precision); }
+
+private:
+  enum class Field : std::uint8_t
+  {
+    Literal,
+    Time,
+    Level,
+    Thread,
+    File,
+    Line,
+    Function,
+    Message
+  };
+
+  struct Operation
+  {
+    Field field;
+    // Where the text of a literal is, in m_literals.
+    std::uint32_t offset;
+    std::uint32_t size;
+  };
+
+  void add_literal(std::string_view text);
+
+  std::vector<Operation> m_operations;
+  std::string m_literals;
+  std::array<std::string, 6> m_levels;
+  TimestampCache m_timestamps;
+};
+
+} // namespace hage
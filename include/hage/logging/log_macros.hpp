@@ -0,0 +1,81 @@
+#pragma once
+
+#include "logger.hpp"
+
+#include <source_location>
+
+/**
+ * Logging macros that are removed at compile time below HAGE_ACTIVE_LOG_LEVEL, including the evaluation of their
+ * arguments. Every statement that remains gets a static site with its format string, level and source location, and
+ * only evaluates its arguments when the logger's min log level lets the line through.
+ *
+ * They work with anything that has should_log and log_at, such as Logger and MultiProducerLogger:
+ *
+ *   HAGE_LOG_INFO(logger, "Got {} bytes from {}", size, peer);
+ */
+
+#define HAGE_LOG_LEVEL_TRACE 0
+#define HAGE_LOG_LEVEL_DEBUG 1
+#define HAGE_LOG_LEVEL_INFO 2
+#define HAGE_LOG_LEVEL_WARN 3
+#define HAGE_LOG_LEVEL_ERROR 4
+#define HAGE_LOG_LEVEL_CRITICAL 5
+#define HAGE_LOG_LEVEL_OFF 6
+
+#ifndef HAGE_ACTIVE_LOG_LEVEL
+#define HAGE_ACTIVE_LOG_LEVEL HAGE_LOG_LEVEL_TRACE
+#endif
+
+static_assert(static_cast<int>(hage::LogLevel::Trace) == HAGE_LOG_LEVEL_TRACE);
+static_assert(static_cast<int>(hage::LogLevel::Debug) == HAGE_LOG_LEVEL_DEBUG);
+static_assert(static_cast<int>(hage::LogLevel::Info) == HAGE_LOG_LEVEL_INFO);
+static_assert(static_cast<int>(hage::LogLevel::Warn) == HAGE_LOG_LEVEL_WARN);
+static_assert(static_cast<int>(hage::LogLevel::Error) == HAGE_LOG_LEVEL_ERROR);
+static_assert(static_cast<int>(hage::LogLevel::Critical) == HAGE_LOG_LEVEL_CRITICAL);
+
+#define HAGE_LOG(logger, logLevel, formatString, ...)                                                                  \
+  do {                                                                                                                 \
+    static constexpr ::hage::StaticLogSite hage_log_site{ logLevel,                                                    \
+                                                          formatString,                                                \
+                                                          ::std::source_location::current() };                         \
+    if (auto& hage_logger = (logger); hage_logger.should_log(hage_log_site.level))                                     \
+      hage_logger.template log_at<&hage_log_site>(__VA_ARGS__);                                                        \
+  } while (false)
+
+#define HAGE_LOG_DISABLED(logger, ...) static_cast<void>(0)
+
+#if HAGE_ACTIVE_LOG_LEVEL <= HAGE_LOG_LEVEL_TRACE
+#define HAGE_LOG_TRACE(logger, ...) HAGE_LOG(logger, ::hage::LogLevel::Trace, __VA_ARGS__)
+#else
+#define HAGE_LOG_TRACE(logger, ...) HAGE_LOG_DISABLED(logger, __VA_ARGS__)
+#endif
+
+#if HAGE_ACTIVE_LOG_LEVEL <= HAGE_LOG_LEVEL_DEBUG
+#define HAGE_LOG_DEBUG(logger, ...) HAGE_LOG(logger, ::hage::LogLevel::Debug, __VA_ARGS__)
+#else
+#define HAGE_LOG_DEBUG(logger, ...) HAGE_LOG_DISABLED(logger, __VA_ARGS__)
+#endif
+
+#if HAGE_ACTIVE_LOG_LEVEL <= HAGE_LOG_LEVEL_INFO
+#define HAGE_LOG_INFO(logger, ...) HAGE_LOG(logger, ::hage::LogLevel::Info, __VA_ARGS__)
+#else
+#define HAGE_LOG_INFO(logger, ...) HAGE_LOG_DISABLED(logger, __VA_ARGS__)
+#endif
+
+#if HAGE_ACTIVE_LOG_LEVEL <= HAGE_LOG_LEVEL_WARN
+#define HAGE_LOG_WARN(logger, ...) HAGE_LOG(logger, ::hage::LogLevel::Warn, __VA_ARGS__)
+#else
+#define HAGE_LOG_WARN(logger, ...) HAGE_LOG_DISABLED(logger, __VA_ARGS__)
+#endif
+
+#if HAGE_ACTIVE_LOG_LEVEL <= HAGE_LOG_LEVEL_ERROR
+#define HAGE_LOG_ERROR(logger, ...) HAGE_LOG(logger, ::hage::LogLevel::Error, __VA_ARGS__)
+#else
+#define HAGE_LOG_ERROR(logger, ...) HAGE_LOG_DISABLED(logger, __VA_ARGS__)
+#endif
+
+#if HAGE_ACTIVE_LOG_LEVEL <= HAGE_LOG_LEVEL_CRITICAL
+#define HAGE_LOG_CRITICAL(logger, ...) HAGE_LOG(logger, ::hage::LogLevel::Critical, __VA_ARGS__)
+#else
+#define HAGE_LOG_CRITICAL(logger, ...) HAGE_LOG_DISABLED(logger, __VA_ARGS__)
+#endif
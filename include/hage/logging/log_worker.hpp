@@ -0,0 +1,127 @@
+#pragma once
+
+#include "logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace hage {
+
+/**
+ * Anything a LogWorker can read from, such as Logger and MultiProducerLogger.
+ */
+template<typename L>
+concept LogSource = requires(L& l, std::size_t n, ConsumerSignal* signal, const Sink::timestamp_type& now) {
+  { l.try_read_logs(n) } -> std::same_as<std::size_t>;
+  l.set_consumer_signal(signal);
+  l.on_idle(now);
+};
+
+/**
+ * A thread that acts as the consumer for any number of loggers. It reads from them in turn, and when none of them have
+ * anything to read it first spins, then yields and finally parks until a producer wakes it up. Before parking, and
+ * every idle interval while parked, it tells the sinks it is idle, so they write out lines they have held on to for too
+ * long.
+ *
+ * The loggers have to stay alive while they are in the worker, so they have to be removed first if they go away before
+ * it. They can outlive the worker, as it lets go of all of them when it stops.
+ */
+class LogWorker
+{
+public:
+  struct IdlePolicy
+  {
+    // The number of empty polls where we spin with a pause between them.
+    std::size_t spins{ 1000 };
+    // The number of empty polls after that, where we yield between them. After this we park.
+    std::size_t yields{ 100 };
+    // How long we park before looking at the sinks again. This bounds how late a sink's max delay can be acted on.
+    std::chrono::milliseconds idleInterval{ 100 };
+  };
+
+  LogWorker();
+
+  /**
+   * @param policy How the worker waits, when there is nothing to read.
+   * @param batchSize The max number of lines read from each logger, before moving on to the next one.
+   */
+  explicit LogWorker(IdlePolicy policy, std::size_t batchSize = 64);
+
+  // Stops the worker, after it has read everything that is left.
+  ~LogWorker();
+
+  LogWorker(const LogWorker&) = delete;
+  LogWorker& operator=(const LogWorker&) = delete;
+
+  template<LogSource L>
+  void add(L& logger)
+  {
+    {
+      std::scoped_lock lock(m_mutex);
+      logger.set_consumer_signal(&m_signal);
+      m_sources.push_back(Source{
+        &logger,
+        [](void* l, const std::size_t maxRecords) { return static_cast<L*>(l)->try_read_logs(maxRecords); },
+        [](void* l) { static_cast<L*>(l)->set_consumer_signal(nullptr); },
+        [](void* l, const Sink::timestamp_type& now) { static_cast<L*>(l)->on_idle(now); } });
+    }
+
+    // The logger might already have something for us.
+    m_signal.wake();
+  }
+
+  /**
+   * Removes the logger from the worker. Once this returns, the worker will never touch it again. Any lines still in it
+   * are not read.
+   */
+  template<LogSource L>
+  void remove(L& logger)
+  {
+    std::scoped_lock lock(m_mutex);
+    logger.set_consumer_signal(nullptr);
+    std::erase_if(m_sources, [&logger](const Source& source) { return source.logger == &logger; });
+  }
+
+  /**
+   * Stops the worker and waits for it to read everything that is left in the loggers, then removes them all. The
+   * producers must be done logging before this is called, or their last lines might not be read.
+   */
+  void stop();
+
+private:
+  struct Source
+  {
+    void* logger;
+    std::size_t (*read)(void* logger, std::size_t maxRecords);
+    // Stops the logger from waking us, as it would otherwise keep pointing at our signal.
+    void (*detach)(void* logger);
+    void (*idle)(void* logger, const Sink::timestamp_type& now);
+  };
+
+  void run(const std::stop_token& stopToken);
+
+  // Reads a batch from each of the loggers, and returns the number of lines read.
+  std::size_t poll();
+
+  // Tells the loggers' sinks that we have nothing to read.
+  void idle();
+
+  ConsumerSignal m_signal;
+  IdlePolicy m_policy;
+  std::size_t m_batchSize;
+
+  // Held by the worker while it polls, so adding and removing loggers is safe at any time.
+  std::mutex m_mutex;
+  std::vector<Source> m_sources;
+
+  // This is last, so the thread starts after everything else is constructed.
+  std::jthread m_thread;
+};
+
+} // namespace hage
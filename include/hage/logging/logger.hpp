@@ -4,8 +4,30 @@
 
 #include <fmt/compile.h>
 #include <fmt/core.h>
+#include <fmt/format.h>
 #include <hage/atomic/atomic.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <source_location>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <hage/core/assert.hpp>
+#include <hage/core/misc.hpp>
+
+#include "clock.hpp"
+#include "raw_sink.hpp"
 #include "serializers.hpp"
 #include "sink.hpp"
 
@@ -42,391 +64,1233 @@ operator""_fmt()
 }
 } // namespace literals
 
-// Single producer, single consumer logger.
-class Logger
+/**
+ * A fmt::format_string that can only be made from a compile time string. The string then lives for the whole program,
+ * so the logger only passes a pointer to it through the buffer, instead of copying it.
+ */
+template<typename... Args>
+class LogFormatString
 {
 public:
-  Logger(ByteBuffer* buffer, Sink* sink, const std::size_t maxMessageSize = 1000)
-    : m_buffer{ buffer }
-    , m_sink{ sink }
-    , m_maxMessageSize(maxMessageSize)
-    , m_capacity(buffer->capacity())
+  template<typename S>
+    requires std::is_convertible_v<const S&, std::string_view>
+  consteval LogFormatString(const S& s)
+    : m_format(s)
   {
-    if (m_capacity < m_maxMessageSize)
-      throw std::runtime_error("The buffer needs to be able to store at least one message");
-
-    m_bytesAvailible.store(m_capacity);
   }
 
-  void set_min_log_level(const LogLevel level) { m_minLevel.store(level, std::memory_order::relaxed); }
+  [[nodiscard]] constexpr std::string_view get() const { return { m_format.get().data(), m_format.get().size() }; }
 
-  bool try_read_log()
-  {
-    if (m_bytesAvailible.load(std::memory_order::acquire) == m_capacity)
-      return false;
+private:
+  fmt::format_string<Args...> m_format;
+};
 
-    const auto bytesRead = internal_read_log();
+/**
+ * A small number for the calling thread, handed out in the order threads first ask for it and starting at 1. It is what
+ * the {thread} field of a LinePattern prints, and is easier to read than the id the system gives the thread.
+ */
+inline std::uint32_t
+this_thread_log_id()
+{
+  static std::atomic<std::uint32_t> next{ 1 };
+  thread_local const std::uint32_t id = next.fetch_add(1, std::memory_order::relaxed);
+  return id;
+}
 
-    m_bytesAvailible.fetch_add(bytesRead, std::memory_order::release);
-    m_bytesAvailible.notify_one();
-    return true;
+/**
+ * The lines a logger has read and formatted, waiting to be passed to the sink in one go. The memory is kept between
+ * batches, so it stops allocating once it has grown to fit.
+ */
+class RecordBatch
+{
+public:
+  // Appends a line, which `format` writes to the output iterator it is given.
+  template<typename F>
+  void add(const LogLevel level, const Sink::timestamp_type& ts, const SourceLocation& location, F&& format)
+  {
+    m_offsets.push_back(m_text.size());
+    std::forward<F>(format)(std::back_inserter(m_text));
+    m_records.push_back(Sink::Record{ level, ts, {}, location, m_thread });
   }
 
-  // This can only be used with the log function pair, otherwise
-  // this thread will never be woken up again.
-  void read_log()
+  // The thread the lines added from now on were logged from.
+  void set_thread(const std::uint32_t thread) { m_thread = thread; }
+
+  // The records, with their lines pointing into the batch. They are valid until the batch is changed.
+  [[nodiscard]] std::span<const Sink::Record> records()
   {
-    // We know we are the only reader, so we are just going to wait until we can claim some bytes.
-    m_bytesAvailible.wait(m_capacity, std::memory_order::acquire);
+    for (std::size_t i = 0; i < m_records.size(); i++) {
+      const auto end = i + 1 < m_offsets.size() ? m_offsets[i + 1] : m_text.size();
+      m_records[i].line = std::string_view(m_text.data() + m_offsets[i], end - m_offsets[i]);
+    }
+    return m_records;
+  }
 
-    const auto bytesRead = internal_read_log();
-    if (bytesRead == 0)
-      throw std::runtime_error("We were unable to read from read_log, this should never happen");
+  [[nodiscard]] bool empty() const { return m_records.empty(); }
+  [[nodiscard]] std::size_t text_size() const { return m_text.size(); }
 
-    // we remove the bytes from the ring buffer.
-    m_bytesAvailible.fetch_add(bytesRead, std::memory_order::release);
-    m_bytesAvailible.notify_one();
+  void clear()
+  {
+    m_text.clear();
+    m_records.clear();
+    m_offsets.clear();
   }
 
-  template<typename Rep, typename Period>
-  bool read_log(const std::chrono::duration<Rep, Period>& timeout)
-  {
+private:
+  fmt::memory_buffer m_text;
+  std::vector<Sink::Record> m_records;
+  std::vector<std::size_t> m_offsets;
+  std::uint32_t m_thread{ 0 };
+};
 
-    if (!m_bytesAvailible.wait_for(m_capacity, timeout, std::memory_order::acquire))
-      return false;
+/**
+ * What the consumer needs to pass lines on to a RawSink. Reused between lines, so it doesn't allocate once warm.
+ */
+struct RawContext
+{
+  RawSink* sink{ nullptr };
+  std::vector<std::byte> arguments;
+  fmt::memory_buffer line;
+};
 
-    const auto bytesRead = internal_read_log();
-    if (bytesRead == 0)
-      throw std::runtime_error("We were unable to read from read_log, this should never happen");
+/**
+ * The static description of a log statement. Only a pointer to it goes through the buffer, followed by the timestamp
+ * and the arguments, so the level and format string are never copied.
+ *
+ * @tparam Reader The reader the rest of the message is decoded from.
+ */
+template<typename Reader>
+struct LogSite : LogSiteInfo
+{
+  // Reads the rest of the message, and adds the formatted line to the batch. This is where the argument types are kept.
+  bool (*decode)(const LogSite& site, Reader& reader, RecordBatch& batch);
 
-    // we remove the bytes from the ring buffer.
-    m_bytesAvailible.fetch_add(bytesRead, std::memory_order::release);
-    m_bytesAvailible.notify_one();
+  // Reads the rest of the message, and passes it to the raw sink without formatting it, if the arguments allow it.
+  bool (*decode_raw)(const LogSite& site, Reader& reader, RawContext& context);
+};
 
-    return true;
-  }
+/**
+ * The part of a LogSite that is known where the statement is written. The HAGE_LOG macros make one of these as a static
+ * for each statement, and the logger builds the full LogSite from a pointer to it.
+ */
+struct StaticLogSite
+{
+  LogLevel level;
+  std::string_view format;
+  std::source_location location;
+};
 
-  // Synchronus code
-  template<typename... Args>
-  void log(const LogLevel logLevel,
-           fmt::format_string<typename SmartSerializer<Args>::serialized_type...> fmt,
-           Args&&... args)
-  {
-    common_log(logLevel, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
-  }
+namespace detail {
+// Lets a StaticLogSite be used where a FormatString is expected.
+template<const StaticLogSite* Site>
+struct StaticSiteFormat
+{
+  static constexpr std::string_view string = Site->format;
+};
 
-  template<auto S, typename... Args>
-  void log(const LogLevel logLevel, FormatString<S>&& f, Args&&... args)
-  {
-    common_log(logLevel, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
-  }
+// What became of a message we tried to write to the buffer.
+enum class WriteResult : std::uint8_t
+{
+  Written,
+  // There is no room for it yet, there will be once the consumer has caught up.
+  Full,
+  // It is larger than the max message size, so it will never fit.
+  TooLarge,
+};
 
+// Calls `f` with the level as a template argument, so each level can get its own static LogSite.
+template<typename F>
+decltype(auto)
+visit_level(const LogLevel level, F&& f)
+{
+  switch (level) {
+    case LogLevel::Trace:
+      return std::forward<F>(f).template operator()<LogLevel::Trace>();
+    case LogLevel::Debug:
+      return std::forward<F>(f).template operator()<LogLevel::Debug>();
+    case LogLevel::Info:
+      return std::forward<F>(f).template operator()<LogLevel::Info>();
+    case LogLevel::Warn:
+      return std::forward<F>(f).template operator()<LogLevel::Warn>();
+    case LogLevel::Error:
+      return std::forward<F>(f).template operator()<LogLevel::Error>();
+    case LogLevel::Critical:
+      break;
+  }
+  return std::forward<F>(f).template operator()<LogLevel::Critical>();
+}
+} // namespace detail
+
+/**
+ * The per level logging functions, shared by the logger front ends. The derived class only has to provide `log` and
+ * `try_log`, for both the LogFormatString and the FormatString versions.
+ */
+template<typename Derived>
+class LogFunctions
+{
+public:
   template<typename... Args>
-  void trace(fmt::format_string<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
+  void trace(LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
   {
-    log(LogLevel::Trace, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    self().log(LogLevel::Trace, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
   void trace(FormatString<S>&& f, Args&&... args)
   {
-    log(LogLevel::Trace, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    self().log(LogLevel::Trace, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  void debug(fmt::format_string<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
+  void debug(LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
   {
-    log(LogLevel::Debug, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    self().log(LogLevel::Debug, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
   void debug(FormatString<S>&& f, Args&&... args)
   {
-    log(LogLevel::Debug, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    self().log(LogLevel::Debug, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  void info(fmt::format_string<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
+  void info(LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
   {
-    log(LogLevel::Info, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    self().log(LogLevel::Info, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
   void info(FormatString<S>&& f, Args&&... args)
   {
-    log(LogLevel::Info, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    self().log(LogLevel::Info, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  void warn(fmt::format_string<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
+  void warn(LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
   {
-    log(LogLevel::Warn, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    self().log(LogLevel::Warn, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
   void warn(FormatString<S>&& f, Args&&... args)
   {
-    log(LogLevel::Warn, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    self().log(LogLevel::Warn, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  void error(fmt::format_string<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
+  void error(LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
   {
-    log(LogLevel::Error, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    self().log(LogLevel::Error, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
   void error(FormatString<S>&& f, Args&&... args)
   {
-    log(LogLevel::Error, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    self().log(LogLevel::Error, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  void critical(fmt::format_string<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
+  void critical(LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt, Args&&... args)
   {
-    log(LogLevel::Critical, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    self().log(LogLevel::Critical, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
   void critical(FormatString<S>&& f, Args&&... args)
   {
-    log(LogLevel::Critical, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    self().log(LogLevel::Critical, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+  }
+
+  template<auto S, typename... Args>
+  bool try_trace(FormatString<S>&& f, Args&&... args)
+  {
+    return self().try_log(LogLevel::Trace, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
-  // Async function
   template<typename... Args>
-  bool try_log(const LogLevel logLevel,
-               fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt,
-               Args&&... args)
+  bool try_trace(LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
   {
-    return common_try_log(logLevel, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Trace, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
-  bool try_log(const LogLevel logLevel, FormatString<S>&& f, Args&&... args)
+  bool try_debug(FormatString<S>&& f, Args&&... args)
   {
-    return common_try_log(logLevel, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Debug, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+  }
+
+  template<typename... Args>
+  bool try_debug(LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
+  {
+    return self().try_log(LogLevel::Debug, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
-  bool try_trace(FormatString<S>&& f, Args&&... args)
+  bool try_info(FormatString<S>&& f, Args&&... args)
   {
-    return try_log(LogLevel::Trace, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Info, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  bool try_trace(fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
+  bool try_info(LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
   {
-    return try_log(LogLevel::Trace, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Info, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
-  bool try_debug(FormatString<S>&& f, Args&&... args)
+  bool try_warn(FormatString<S>&& f, Args&&... args)
   {
-    return try_log(LogLevel::Debug, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Warn, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  bool try_debug(fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
+  bool try_warn(LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
   {
-    return try_log(LogLevel::Debug, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Warn, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
-  bool try_info(FormatString<S>&& f, Args&&... args)
+  bool try_error(FormatString<S>&& f, Args&&... args)
   {
-    return try_log(LogLevel::Info, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Error, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  bool try_info(fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
+  bool try_error(LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
   {
-    return try_log(LogLevel::Info, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Error, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
-  bool try_warn(FormatString<S>&& f, Args&&... args)
+  bool try_critical(FormatString<S>&& f, Args&&... args)
   {
-    return try_log(LogLevel::Warn, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Critical, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
   template<typename... Args>
-  bool try_warn(fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
+  bool try_critical(LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
   {
-    return try_log(LogLevel::Warn, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    return self().try_log(LogLevel::Critical, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
-  template<auto S, typename... Args>
-  bool try_error(FormatString<S>&& f, Args&&... args)
+private:
+  Derived& self() { return static_cast<Derived&>(*this); }
+};
+
+/**
+ * Lets a consumer that serves many loggers, such as LogWorker, sleep until any of them has something to read, or until
+ * a timeout so it can look at its sinks now and then. The consumer waits on a condition variable, which is only
+ * notified when the epoch changes.
+ *
+ * The producers only touch it after publishing a message, and only write to it when the consumer is parked. For this
+ * to not lose any wakeups, the producer must publish with a seq_cst operation and the consumer must check for messages
+ * with a seq_cst load, after prepare_park.
+ */
+class alignas(detail::destructive_interference_size) ConsumerSignal
+{
+public:
+  // Called by the producers after they have published a message.
+  void notify()
+  {
+    if (m_parked.load(std::memory_order::seq_cst))
+      wake();
+  }
+
+  // Wakes the consumer up, whether it has parked or not.
+  void wake()
+  {
+    {
+      // Under the lock, so a parking consumer can't miss it between checking the epoch and waiting.
+      std::scoped_lock lock(m_mutex);
+      m_epoch.fetch_add(1, std::memory_order::release);
+    }
+    m_woken.notify_one();
+  }
+
+  /**
+   * Tells the producers that we are about to park. The consumer has to check for messages after this, and then either
+   * park with the returned epoch or call cancel_park.
+   */
+  [[nodiscard]] std::uint32_t prepare_park()
+  {
+    const auto epoch = m_epoch.load(std::memory_order::acquire);
+    m_parked.store(true, std::memory_order::seq_cst);
+    return epoch;
+  }
+
+  /**
+   * Sleeps until woken, or until `timeout` has passed.
+   *
+   * @return If we were woken, rather than timing out.
+   */
+  template<typename Rep, typename Period>
+  bool park_for(const std::uint32_t epoch, const std::chrono::duration<Rep, Period>& timeout)
+  {
+    bool woken;
+    {
+      std::unique_lock lock(m_mutex);
+      woken = m_woken.wait_for(
+        lock, timeout, [this, epoch]() { return m_epoch.load(std::memory_order::acquire) != epoch; });
+    }
+    m_parked.store(false, std::memory_order::relaxed);
+    return woken;
+  }
+
+  void cancel_park() { m_parked.store(false, std::memory_order::relaxed); }
+
+private:
+  std::atomic<bool> m_parked{ false };
+  std::atomic<std::uint32_t> m_epoch{ 0 };
+
+  // Atomics can't be waited on with a timeout, so the consumer waits on this instead.
+  std::mutex m_mutex;
+  std::condition_variable m_woken;
+};
+
+/**
+ * What a producer does when a line doesn't fit in the buffer.
+ */
+enum class OverflowPolicy : std::uint8_t
+{
+  // Wait for the consumer to make room.
+  Block,
+  // Drop the line, and carry on. Critical lines still wait, so they are never lost.
+  DropNewest
+};
+
+/**
+ * Single producer, single consumer logger.
+ *
+ * @tparam Buffer The buffer used to pass messages between the producer and the consumer. When this is a
+ * StaticByteBuffer, such as RingBuffer, the reader and writer are kept on the stack and all calls into them are
+ * resolved at compile time. Any other ByteBuffer is used through its virtual interface.
+ * @tparam Clock The clock the producer timestamps each line with, when it is logged.
+ */
+template<std::derived_from<ByteBuffer> Buffer = ByteBuffer, LogClock Clock = SystemClock>
+class Logger : public LogFunctions<Logger<Buffer, Clock>>
+{
+public:
+  Logger(Buffer* buffer, Sink* sink, const std::size_t maxMessageSize = 1000)
+    : m_buffer{ buffer }
+    , m_sink{ sink }
+    , m_maxMessageSize(maxMessageSize)
+    , m_capacity(buffer->capacity())
+  {
+    if (m_capacity < m_maxMessageSize)
+      throw std::runtime_error("The buffer needs to be able to store at least one message");
+
+    if constexpr (ReservableByteBuffer<Buffer>) {
+      if (m_buffer->max_reservation() < m_maxMessageSize)
+        throw std::runtime_error("The buffer needs to be able to reserve at least one message");
+    } else {
+      // No message is larger than this, so the strings in it always fit.
+      m_arena.resize(m_maxMessageSize);
+    }
+
+    m_raw.sink = dynamic_cast<RawSink*>(sink);
+  }
+
+  void set_min_log_level(const LogLevel level) { m_minLevel.store(level, std::memory_order::relaxed); }
+
+  /**
+   * Sets the thread the sinks are told the lines come from. A logger has a single producer, so this is per logger, and it
+   * defaults to the thread that made the logger. The producer can call this with this_thread_log_id() when it starts.
+   */
+  void set_thread_id(const std::uint32_t id) { m_threadId.store(id, std::memory_order::relaxed); }
+
+  /**
+   * Sets what log does when the buffer is full. Only the producer reads this, so it has to be set from the producer
+   * thread, or before it starts logging.
+   */
+  void set_overflow_policy(const OverflowPolicy policy) { m_overflowPolicy = policy; }
+
+  /**
+   * The number of lines at `level` that were lost because they didn't fit, either dropped by log or failed by try_log.
+   * The counts are kept by the producer, so this can only be called from the producer thread.
+   *
+   * The consumer is told as well. Once a line fits again, a warning with the number of lines dropped since the last such
+   * warning is logged before it.
+   */
+  [[nodiscard]] std::uint64_t dropped(const LogLevel level) const
+  {
+    return m_dropped[static_cast<std::size_t>(level)];
+  }
+
+  /**
+   * A snapshot of what the logger has done, which can be taken from any thread. The counters are each written by only
+   * the producer or the consumer, and published with relaxed stores, so they are cheap enough to always keep. They are
+   * not taken at the same instant though, so they only add up once both sides are idle.
+   */
+  struct Stats
+  {
+    std::uint64_t messagesWritten;
+    std::uint64_t bytesWritten;
+    std::uint64_t messagesRead;
+    std::uint64_t bytesRead;
+
+    // Bytes in the buffer, out of its capacity. The peak is the most there has been right after a message was written.
+    std::size_t capacity;
+    std::size_t occupancy;
+    std::size_t peakOccupancy;
+
+    // How often, and for how long, log waited for the consumer to make room.
+    std::uint64_t producerWaits;
+    std::chrono::nanoseconds producerWaitTime;
+
+    // Time the consumer spent reading and formatting lines, and passing them to the sink. Lines for a RawSink are
+    // passed on while they are read, so that time is counted as reading.
+    std::chrono::nanoseconds decodeTime;
+    std::chrono::nanoseconds sinkTime;
+  };
+
+  [[nodiscard]] Stats stats() const
+  {
+    constexpr auto relaxed = std::memory_order::relaxed;
+    // Read first, so it is never ahead of what was written.
+    const auto read = m_read.load(std::memory_order::acquire);
+    const auto written = m_written.load(std::memory_order::acquire);
+    return Stats{
+      .messagesWritten = m_producerStats.messages.load(relaxed),
+      .bytesWritten = written,
+      .messagesRead = m_consumerStats.messages.load(relaxed),
+      .bytesRead = read,
+      .capacity = m_capacity,
+      .occupancy = written - read,
+      .peakOccupancy = m_producerStats.peakOccupancy.load(relaxed),
+      .producerWaits = m_producerStats.waits.load(relaxed),
+      .producerWaitTime = std::chrono::nanoseconds(m_producerStats.waitNanos.load(relaxed)),
+      .decodeTime = std::chrono::nanoseconds(m_consumerStats.decodeNanos.load(relaxed)),
+      .sinkTime = std::chrono::nanoseconds(m_consumerStats.sinkNanos.load(relaxed)),
+    };
+  }
+
+  [[nodiscard]] bool should_log(const LogLevel level) const
+  {
+    return m_minLevel.load(std::memory_order::relaxed) <= level;
+  }
+
+  /**
+   * Makes the producer notify `signal` after each message, for consumers that serve many loggers. Pass nullptr to
+   * detach it again. The signal has to outlive any producer that might still be logging.
+   */
+  void set_consumer_signal(ConsumerSignal* signal) { m_consumerSignal.store(signal, std::memory_order::release); }
+
+  bool try_read_log() { return try_read_logs(1) == 1; }
+
+  // This can only be used with the log function pair, otherwise
+  // this thread will never be woken up again.
+  void read_log() { read_logs(1); }
+
+  template<typename Rep, typename Period>
+  bool read_log(const std::chrono::duration<Rep, Period>& timeout)
+  {
+    return read_logs(1, timeout) == 1;
+  }
+
+  /**
+   * Reads up to `maxRecords` log lines, without waiting. All the lines are committed to the buffer at once, and the
+   * freed space is handed back to the producer with a single atomic operation and notification.
+   *
+   * Only the lines that were in the buffer when the call started are read, so this finishes even if the producer keeps
+   * logging.
+   *
+   * @return The number of log lines read.
+   */
+  std::size_t try_read_logs(const std::size_t maxRecords)
+  {
+    // seq_cst, so that a consumer parking on a ConsumerSignal doesn't miss a message.
+    const auto used = m_written.load(std::memory_order::seq_cst) - m_read.load(std::memory_order::relaxed);
+    if (used == 0)
+      return 0;
+
+    return internal_read_logs(maxRecords, used);
+  }
+
+  /**
+   * Like try_read_logs, but waits until there is at least one log line to read.
+   */
+  std::size_t read_logs(const std::size_t maxRecords)
+  {
+    // We know we are the only reader, so we are just going to wait until something has been written past what we read.
+    park_until_changed(m_written, m_read.load(std::memory_order::relaxed), m_consumerParked);
+
+    const auto records = try_read_logs(maxRecords);
+    if (records == 0)
+      throw std::runtime_error("We were unable to read from read_log, this should never happen");
+
+    return records;
+  }
+
+  template<typename Rep, typename Period>
+  std::size_t read_logs(const std::size_t maxRecords, const std::chrono::duration<Rep, Period>& timeout)
   {
-    return try_log(LogLevel::Error, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    // This polls rather than sleeping, so there is no need to park.
+    if (!m_written.wait_for(m_read.load(std::memory_order::relaxed), timeout, std::memory_order::acquire)) {
+      on_idle(std::chrono::system_clock::now());
+      return 0;
+    }
+
+    const auto records = try_read_logs(maxRecords);
+    if (records == 0)
+      throw std::runtime_error("We were unable to read from read_log, this should never happen");
+
+    return records;
   }
 
+  /**
+   * Reads all the log lines that are currently in the buffer.
+   *
+   * @return The number of log lines read.
+   */
+  std::size_t drain() { return try_read_logs(std::numeric_limits<std::size_t>::max()); }
+
+  /**
+   * Tells the sink that there is nothing to read, so it can write out lines it has held on to for too long. read_logs
+   * does this when it times out, consumers that only use try_read_logs should call it when they find nothing.
+   */
+  void on_idle(const Sink::timestamp_type& now) { m_sink->on_idle(now); }
+
+  // Synchronus code
   template<typename... Args>
-  bool try_error(fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
+  void log(const LogLevel logLevel,
+           LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt,
+           Args&&... args)
   {
-    return try_log(LogLevel::Error, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    common_log(logLevel, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
   }
 
   template<auto S, typename... Args>
-  bool try_critical(FormatString<S>&& f, Args&&... args)
+  void log(const LogLevel logLevel, FormatString<S>&& f, Args&&... args)
   {
-    return try_log(LogLevel::Critical, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+    common_log(logLevel, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
   }
 
+  // Async function
   template<typename... Args>
-  bool try_critical(fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt, Args&&... args)
+  bool try_log(const LogLevel logLevel,
+               LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt,
+               Args&&... args)
+  {
+    return common_try_log(logLevel, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+  }
+
+  template<auto S, typename... Args>
+  bool try_log(const LogLevel logLevel, FormatString<S>&& f, Args&&... args)
+  {
+    return common_try_log(logLevel, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+  }
+
+  /**
+   * Logs through a static site, without checking the min log level. This is what the HAGE_LOG macros expand to, after
+   * they have checked should_log, so the arguments are only evaluated when the line is logged.
+   */
+  template<const StaticLogSite* Site, typename... Args>
+  void log_at(Args&&... args)
+  {
+    blocking_log(Site->level, detail::StaticSiteFormat<Site>{}, std::forward<Args>(args)...);
+  }
+
+  template<const StaticLogSite* Site, typename... Args>
+  bool try_log_at(Args&&... args)
   {
-    return try_log(LogLevel::Critical, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+    return counted_try_log(Site->level, Clock::now(), detail::StaticSiteFormat<Site>{}, std::forward<Args>(args)...);
   }
 
 private:
-  using logging_function = std::add_pointer_t<bool(ByteBuffer::Reader& l, Sink&)>;
+  // Reservable buffers let us serialize a whole message straight into the buffer, and read it back in place. Others have
+  // their strings copied into an arena, so they can be read as views as well.
+  using reader_type =
+    std::conditional_t<ReservableByteBuffer<Buffer>, SpanReader, ArenaReader<typename Buffer::Reader>>;
+  using writer_type = std::conditional_t<ReservableByteBuffer<Buffer>, SpanWriter, typename Buffer::Writer>;
+  using site_type = LogSite<reader_type>;
+
+  template<typename... Args>
+  using arguments_type = std::tuple<typename SmartSerializer<Args>::serialized_type...>;
+
+  template<typename... Args>
+  static bool read_arguments(reader_type& reader, arguments_type<Args...>& results)
+  {
+    return [&results, &reader]<std::size_t... Is>(std::index_sequence<Is...>) {
+      return (... and read_from_buffer<Args>(reader, std::get<Is>(results)));
+    }(std::index_sequence_for<Args...>{});
+  }
+
+  template<typename Format, typename... Args>
+  static bool decode_compiled(const site_type& site, reader_type& reader, RecordBatch& batch)
+  {
+    std::uint64_t timestamp;
+    if (!read_from_buffer<std::uint64_t>(reader, timestamp))
+      return false;
+
+    // not using an optional because your interface effectively requires default constructibility anyway
+    arguments_type<Args...> results;
+    if (!read_arguments<Args...>(reader, results))
+      return false;
+
+    batch.add(site.level, Clock::to_timestamp(timestamp), site.location, [&results](auto out) {
+      std::apply([out](auto&&... ts) { fmt::format_to(out, FMT_COMPILE(Format::string), ts...); }, results);
+    });
+    return true;
+  }
+
+  template<typename... Args>
+  static bool decode_runtime(const site_type& site, reader_type& reader, RecordBatch& batch)
+  {
+    std::uint64_t timestamp;
+    if (!read_from_buffer<std::uint64_t>(reader, timestamp))
+      return false;
+
+    const void* formatData;
+    std::size_t formatSize;
+    if (!read_from_buffer<const void*>(reader, formatData) || !read_from_buffer<std::size_t>(reader, formatSize))
+      return false;
+
+    arguments_type<Args...> results;
+    if (!read_arguments<Args...>(reader, results))
+      return false;
+
+    const std::string_view format(static_cast<const char*>(formatData), formatSize);
+    batch.add(site.level, Clock::to_timestamp(timestamp), site.location, [&results, format](auto out) {
+      std::apply([out, format](auto&&... ts) { fmt::vformat_to(out, format, fmt::make_format_args(ts...)); }, results);
+    });
+    return true;
+  }
+
+  template<typename Format, typename... Args>
+  static bool decode_compiled_raw(const site_type& site, reader_type& reader, RawContext& context)
+  {
+    std::uint64_t timestamp;
+    if (!read_from_buffer<std::uint64_t>(reader, timestamp))
+      return false;
+
+    return forward_raw<Args...>(site, Format::string, Clock::to_timestamp(timestamp), reader, context);
+  }
+
+  template<typename... Args>
+  static bool decode_runtime_raw(const site_type& site, reader_type& reader, RawContext& context)
+  {
+    std::uint64_t timestamp;
+    if (!read_from_buffer<std::uint64_t>(reader, timestamp))
+      return false;
+
+    const void* formatData;
+    std::size_t formatSize;
+    if (!read_from_buffer<const void*>(reader, formatData) || !read_from_buffer<std::size_t>(reader, formatSize))
+      return false;
+
+    const std::string_view format(static_cast<const char*>(formatData), formatSize);
+    return forward_raw<Args...>(site, format, Clock::to_timestamp(timestamp), reader, context);
+  }
+
+  // Described arguments are serialized back to back for the raw sink, which can then decode them without their types.
+  // Anything else has to be formatted here, while we still know the types.
+  template<typename... Args>
+  static bool forward_raw(const site_type& site,
+                          const std::string_view format,
+                          const Sink::timestamp_type timestamp,
+                          reader_type& reader,
+                          RawContext& context)
+  {
+    arguments_type<Args...> results;
+    if (!read_arguments<Args...>(reader, results))
+      return false;
+
+    if constexpr ((... && (argument_type_of<Args>() != ArgumentType::Unsupported))) {
+      context.arguments.clear();
+      VectorWriter writer(context.arguments);
+      std::apply([&writer](const auto&... ts) { (..., write_to_buffer(writer, ts)); }, results);
+      context.sink->receive_raw(RawRecord{ &site, format, timestamp, context.arguments });
+    } else {
+      context.line.clear();
+      std::apply(
+        [&context, format](auto&&... ts) {
+          fmt::vformat_to(std::back_inserter(context.line), format, fmt::make_format_args(ts...));
+        },
+        results);
+      context.sink->receive(site.level, timestamp, std::string_view(context.line.data(), context.line.size()));
+    }
+    return true;
+  }
+
+  template<typename... Args>
+  static constexpr std::array<ArgumentType, sizeof...(Args)> s_argumentTypes{ argument_type_of<Args>()... };
+
+  template<LogLevel Level, auto S, typename... Args>
+  static constexpr site_type s_compiledSite{ { Level, FormatString<S>::string, {}, s_argumentTypes<Args...> },
+                                             &decode_compiled<FormatString<S>, Args...>,
+                                             &decode_compiled_raw<FormatString<S>, Args...> };
+
+  // Statements from the HAGE_LOG macros get a site each, with their source location.
+  template<const StaticLogSite* Site, typename... Args>
+  static constexpr site_type s_staticSite{ { Site->level, Site->format, Site->location, s_argumentTypes<Args...> },
+                                           &decode_compiled<detail::StaticSiteFormat<Site>, Args...>,
+                                           &decode_compiled_raw<detail::StaticSiteFormat<Site>, Args...> };
+
+  // Statements with runtime format strings share a site per level and argument types, and pass the string themselves.
+  template<LogLevel Level, typename... Args>
+  static constexpr site_type s_runtimeSite{ { Level, {}, {}, s_argumentTypes<Args...> },
+                                            &decode_runtime<Args...>,
+                                            &decode_runtime_raw<Args...> };
 
   std::atomic<LogLevel> m_minLevel{ LogLevel::Info };
+  std::atomic<std::uint32_t> m_threadId{ this_thread_log_id() };
+
+  // Only used by the producer, so none of these need to be atomic.
+  OverflowPolicy m_overflowPolicy{ OverflowPolicy::Block };
+  std::array<std::uint64_t, 6> m_dropped{};
+  std::array<std::uint64_t, 6> m_unreported{};
+  bool m_hasUnreported{ false };
+  // The producer's copy of m_read, as it was the last time it had to look, for room or for the peak.
+  std::size_t m_cachedRead{ 0 };
 
-  ByteBuffer* m_buffer{};
+  // Loaded by the producer for every message, so it is kept with the rest of the producer's state, away from the lines
+  // the consumer writes to.
+  std::atomic<ConsumerSignal*> m_consumerSignal{ nullptr };
+
+  Buffer* m_buffer{};
   Sink* m_sink;
 
   // The max message size in bytes.
   std::size_t m_maxMessageSize;
   std::size_t m_capacity;
 
+  /**
+   * The total number of bytes the producer has written, and the consumer has read. Each is only written by its own side,
+   * with a plain store, and they sit on separate cache lines. The consumer only loads the written count once per read,
+   * and the producer only looks at the read count when a message doesn't fit, so in the steady state neither side
+   * touches the other's line for each message. The buffer keeps its own indices, so these are only for knowing when to
+   * wait and for how much to read.
+   */
   static_assert(std::atomic<std::size_t>::is_always_lock_free);
-  hage::atomic<std::size_t> m_bytesAvailible{ 0 };
+  alignas(detail::destructive_interference_size) hage::atomic<std::size_t> m_written{ 0 };
+  alignas(detail::destructive_interference_size) hage::atomic<std::size_t> m_read{ 0 };
+
+  // Set while the consumer or producer sleeps waiting for the other side. Notifying can be a syscall even when nobody
+  // waits, so the other side only does it when these are set, and otherwise just loads them.
+  alignas(detail::destructive_interference_size) std::atomic<bool> m_consumerParked{ false };
+  alignas(detail::destructive_interference_size) std::atomic<bool> m_producerParked{ false };
+
+  /**
+   * Sleeps until `counter` is no longer `old`. The flag is raised before the counter is checked one last time, and the
+   * other side stores the counter before checking the flag, both seq_cst. So either we see the new value and don't
+   * sleep, or the other side sees the flag and wakes us.
+   */
+  static void park_until_changed(hage::atomic<std::size_t>& counter, const std::size_t old, std::atomic<bool>& parked)
+  {
+    if (counter.load(std::memory_order::acquire) != old)
+      return;
+
+    parked.store(true, std::memory_order::seq_cst);
+    if (counter.load(std::memory_order::seq_cst) == old)
+      counter.wait(old, std::memory_order::acquire);
+    parked.store(false, std::memory_order::relaxed);
+  }
+
+  // Only used by the consumer, and reused for every batch so decoding and formatting doesn't allocate. They start on a
+  // line of their own, so formatting doesn't share one with the flags above.
+  alignas(detail::destructive_interference_size) RecordBatch m_batch;
+  std::vector<std::byte> m_arena;
+
+  // Set when the sink is a RawSink, in which case lines skip the batch and are passed on as they are read.
+  RawContext m_raw;
 
-  // This reads the log and returns how many bytes we read in total.
-  [[nodiscard]] std::size_t internal_read_log()
+  // Each side has its own cache line of counters, and is the only one writing to them, so an update is a relaxed load
+  // and store rather than a read-modify-write.
+  struct alignas(detail::destructive_interference_size) ProducerStats
   {
-    const auto reader = m_buffer->get_reader();
-    logging_function f{ nullptr };
-    auto good = read_from_buffer<logging_function>(*reader, f);
-    good = good && f(*reader, *m_sink);
+    std::atomic<std::uint64_t> messages{ 0 };
+    std::atomic<std::size_t> peakOccupancy{ 0 };
+    std::atomic<std::uint64_t> waits{ 0 };
+    std::atomic<std::int64_t> waitNanos{ 0 };
+  };
 
-    // we try to commit.
-    good = good && reader->commit();
+  struct alignas(detail::destructive_interference_size) ConsumerStats
+  {
+    std::atomic<std::uint64_t> messages{ 0 };
+    std::atomic<std::int64_t> decodeNanos{ 0 };
+    std::atomic<std::int64_t> sinkNanos{ 0 };
+  };
 
-    if (good)
-      return reader->bytes_read();
-    else
-      return 0;
+  ProducerStats m_producerStats;
+  ConsumerStats m_consumerStats;
+
+  template<typename Atomic, typename T>
+  static void publish_add(Atomic& counter, const T value, const std::memory_order order = std::memory_order::relaxed)
+  {
+    counter.store(counter.load(std::memory_order::relaxed) + value, order);
   }
 
-  template<typename... Args>
-  void common_log(const LogLevel logLevel, Args&&... args)
+  static std::int64_t nanos_since(const std::chrono::steady_clock::time_point start)
   {
-    if (logLevel < m_minLevel.load(std::memory_order::relaxed))
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // A batch is passed on early when its lines get this large, so it doesn't grow without bound while draining.
+  static constexpr std::size_t s_maxBatchText = 64 * 1024;
+
+  void deliver_batch()
+  {
+    if (m_batch.empty())
       return;
 
-    m_bytesAvailible.wait_with_predicate([this](const std::size_t v) { return m_maxMessageSize <= v; });
+    const auto start = std::chrono::steady_clock::now();
+    m_sink->receive_batch(m_batch.records());
+    m_batch.clear();
+    publish_add(m_consumerStats.sinkNanos, nanos_since(start));
+  }
+
+  // Static buffers give us their reader and writer by value, so we avoid the allocation and the virtual calls.
+  template<typename F>
+  decltype(auto) with_reader(F&& f)
+  {
+    if constexpr (StaticByteBuffer<Buffer>) {
+      auto reader = m_buffer->reader();
+      return std::forward<F>(f)(reader);
+    } else {
+      const auto reader = m_buffer->get_reader();
+      return std::forward<F>(f)(*reader);
+    }
+  }
 
-    if (!internal_try_log(logLevel, std::forward<Args>(args)...))
-      throw std::runtime_error("We were unable to write to the log, this should never happen");
+  template<typename F>
+  decltype(auto) with_writer(F&& f)
+  {
+    if constexpr (StaticByteBuffer<Buffer>) {
+      auto writer = m_buffer->writer();
+      return std::forward<F>(f)(writer);
+    } else {
+      const auto writer = m_buffer->get_writer();
+      return std::forward<F>(f)(*writer);
+    }
   }
 
+  // The size of a message, when all of its arguments can tell theirs up front.
   template<typename... Args>
-  bool common_try_log(const LogLevel logLevel, Args&&... args)
+  static constexpr std::optional<std::size_t> message_size(const Args&... args)
   {
-    if (logLevel < m_minLevel.load(std::memory_order::relaxed))
-      return true;
+    if constexpr ((... && SizedSerializer<Args>))
+      return (... + encoded_size<Args>(args));
+    else
+      return std::nullopt;
+  }
 
-    return internal_try_log(logLevel, std::forward<Args>(args)...);
+  /**
+   * Serializes a single message with `serialize` and commits it to the buffer. When the size of the message is known,
+   * it is checked against the max message size before anything is written, and a reservable buffer only reserves that
+   * much and is written to without any further checks. Otherwise the message is written, and checked afterwards. The
+   * result tells a message that has to wait for the consumer apart from one that will never fit.
+   */
+  template<typename F>
+  detail::WriteResult write_message(const std::optional<std::size_t> size, F&& serialize)
+  {
+    using detail::WriteResult;
+
+    if (size && m_maxMessageSize < *size)
+      return WriteResult::TooLarge;
+
+    return with_writer([this, size, &serialize](auto& writer) {
+      std::size_t bytesWritten;
+      if constexpr (ReservableByteBuffer<Buffer>) {
+        if (size) {
+          const auto dst = writer.reserve(*size);
+          if (dst.empty())
+            return WriteResult::Full;
+
+          // The room for the whole message is already ours, so a serializer that fails here doesn't match its own
+          // size. That won't get better by waiting for the consumer, so we don't report it as a full buffer.
+          UncheckedSpanWriter out(dst.data());
+          if (!std::forward<F>(serialize)(out)) {
+            HAGE_ASSERT(false, "The message couldn't be written in the size it was given");
+            return WriteResult::TooLarge;
+          }
+
+          HAGE_ASSERT(out.bytes_written() == *size, "The message didn't match the size it was given");
+          if (!writer.commit(*size))
+            return WriteResult::Full;
+        } else if (const auto result = write_unsized(writer, std::forward<F>(serialize));
+                   result != WriteResult::Written) {
+          return result;
+        }
+
+        bytesWritten = writer.bytes_written();
+      } else {
+        if (!std::forward<F>(serialize)(writer))
+          return WriteResult::Full;
+
+        if (!size && m_maxMessageSize < writer.bytes_written())
+          return WriteResult::TooLarge;
+
+        if (!writer.commit())
+          return WriteResult::Full;
+
+        bytesWritten = writer.bytes_written();
+      }
+
+      // seq_cst, so either we see that the consumer is parking, or it sees the message. See park_until_changed.
+      publish_add(m_written, bytesWritten, std::memory_order::seq_cst);
+      if (m_consumerParked.load(std::memory_order::seq_cst)) [[unlikely]]
+        m_written.notify_one();
+
+      publish_add(m_producerStats.messages, std::uint64_t{ 1 });
+      track_peak();
+
+      if (const auto signal = m_consumerSignal.load(std::memory_order::acquire))
+        signal->notify();
+
+      return WriteResult::Written;
+    });
   }
 
-  template<auto S, typename... Args>
-  bool internal_try_log(const LogLevel logLevel, FormatString<S>, Args&&... args)
+  /**
+   * Raises the peak occupancy, if the buffer has never been this full. Our copy of m_read can only be behind, so what it
+   * gives is never less than the real occupancy. The consumer's line is only loaded when that copy says we are past the
+   * peak, to see if we really are.
+   */
+  void track_peak()
   {
-    auto trampoline = +[](ByteBuffer::Reader& reader, Sink& sink) {
-      LogLevel level;
-      if (!read_from_buffer<LogLevel>(reader, level))
-        return false;
+    constexpr auto relaxed = std::memory_order::relaxed;
+    const auto written = m_written.load(relaxed);
+    const auto peak = m_producerStats.peakOccupancy.load(relaxed);
+    if (written - m_cachedRead <= peak)
+      return;
 
-      // not using an optional because your interface effectively requires default constructibility anyway
-      std::tuple<typename SmartSerializer<Args>::serialized_type...> results;
+    m_cachedRead = m_read.load(std::memory_order::acquire);
+    if (peak < written - m_cachedRead)
+      m_producerStats.peakOccupancy.store(written - m_cachedRead, relaxed);
+  }
 
-      const bool success = [&results, &reader]<std::size_t... Is>(std::index_sequence<Is...>) {
-        return (... and read_from_buffer<Args>(reader, std::get<Is>(results)));
-      }(std::index_sequence_for<Args...>{});
+  // Reserves room for the largest message, as we don't know how large this one is until it is written. So a message
+  // that doesn't fit in that room is too large.
+  template<typename Writer, typename F>
+  detail::WriteResult write_unsized(Writer& writer, F&& serialize)
+  {
+    const auto dst = writer.reserve(m_maxMessageSize);
+    if (dst.empty())
+      return detail::WriteResult::Full;
 
-      if (!success)
-        return false;
+    SpanWriter out(dst);
+    if (!std::forward<F>(serialize)(out))
+      return detail::WriteResult::TooLarge;
 
-      auto logLine =
-        std::apply([](auto&&... ts) { return fmt::format(FMT_COMPILE(FormatString<S>::string), ts...); }, results);
+    return writer.commit(out.bytes_written()) ? detail::WriteResult::Written : detail::WriteResult::Full;
+  }
 
-      sink.receive(level, std::chrono::system_clock::now(), logLine);
+  // Reads up to maxRecords messages, or until at least maxBytes have been read, and commits them all at once.
+  std::size_t internal_read_logs(const std::size_t maxRecords, const std::size_t maxBytes)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    const auto sinkNanos = m_consumerStats.sinkNanos.load(std::memory_order::relaxed);
+
+    m_batch.set_thread(m_threadId.load(std::memory_order::relaxed));
+    const auto [records, bytesRead] = with_reader([this, maxRecords, maxBytes](auto& reader) {
+      auto readMessage = [this](reader_type& in) {
+        const site_type* site{ nullptr };
+        if (!read_from_buffer<const site_type*>(in, site))
+          return false;
+        return m_raw.sink ? site->decode_raw(*site, in, m_raw) : site->decode(*site, in, m_batch);
+      };
+
+      std::size_t n = 0;
+      while (n < maxRecords && reader.bytes_read() < maxBytes) {
+        if constexpr (ReservableByteBuffer<Buffer>) {
+          const auto record = reader.read_record();
+          if (record.empty())
+            break;
+
+          SpanReader in(record);
+          if (!readMessage(in))
+            throw std::runtime_error("We were unable to decode a log message, this should never happen");
+        } else {
+          reader_type in(reader, m_arena);
+          if (!readMessage(in))
+            throw std::runtime_error("We were unable to decode a log message, this should never happen");
+        }
+        n++;
+
+        if (s_maxBatchText <= m_batch.text_size())
+          deliver_batch();
+      }
+
+      if (0 < n && !reader.commit())
+        throw std::runtime_error("We were unable to commit the read log messages, this should never happen");
+
+      return std::pair{ n, reader.bytes_read() };
+    });
+
+    if (0 < bytesRead) {
+      // The space is handed back to the producer, which only looks if it is waiting for it.
+      publish_add(m_read, bytesRead, std::memory_order::seq_cst);
+      if (m_producerParked.load(std::memory_order::seq_cst))
+        m_read.notify_one();
+    }
+
+    // The lines don't point into the buffer anymore, so we hand the space back before the sink gets them.
+    deliver_batch();
+
+    publish_add(m_consumerStats.messages, std::uint64_t{ records });
+    const auto sinkTime = m_consumerStats.sinkNanos.load(std::memory_order::relaxed) - sinkNanos;
+    publish_add(m_consumerStats.decodeNanos, nanos_since(start) - sinkTime);
+
+    return records;
+  }
 
-      return true;
-    };
+  template<typename... Args>
+  void common_log(const LogLevel logLevel, Args&&... args)
+  {
+    if (logLevel < m_minLevel.load(std::memory_order::relaxed))
+      return;
 
-    const auto writer = m_buffer->get_writer();
+    blocking_log(logLevel, std::forward<Args>(args)...);
+  }
 
-    bool good = write_to_buffer(*writer, trampoline);
-    good = good && write_to_buffer(*writer, logLevel);
-    good = good && ((write_to_buffer(*writer, std::forward<Args>(args))) && ...);
+  template<typename... Args>
+  void blocking_log(const LogLevel logLevel, Args&&... args)
+  {
+    // We take the timestamp once, so time spent waiting for space isn't counted.
+    const auto timestamp = Clock::now();
 
-    if (m_maxMessageSize < writer->bytes_written())
-      return false;
+    if (m_overflowPolicy == OverflowPolicy::DropNewest && logLevel != LogLevel::Critical) {
+      counted_try_log(logLevel, timestamp, std::forward<Args>(args)...);
+      return;
+    }
+
+    // The free space alone doesn't tell us if the message fits, as reservations have to be contiguous. So we just try,
+    // and only look at how far the consumer has come when it doesn't fit. If it hasn't moved since we last looked, the
+    // try saw the same space, so we wait for it to move. A message that is too large will never fit, so we don't wait
+    // for it, and neither do we for a failure on an empty buffer.
+    for (;;) {
+      const auto result = reporting_try_log(logLevel, timestamp, std::forward<Args>(args)...);
+      if (result == detail::WriteResult::Written)
+        return;
+
+      if (result == detail::WriteResult::TooLarge)
+        throw std::runtime_error("The log message is larger than the max message size");
+
+      const auto read = m_read.load(std::memory_order::acquire);
+      if (read == m_cachedRead) {
+        if (read == m_written.load(std::memory_order::relaxed))
+          throw std::runtime_error("We were unable to write to the log, this should never happen");
+
+        const auto start = std::chrono::steady_clock::now();
+        park_until_changed(m_read, read, m_producerParked);
+        publish_add(m_producerStats.waits, std::uint64_t{ 1 });
+        publish_add(m_producerStats.waitNanos, nanos_since(start));
+      }
+      m_cachedRead = read;
+    }
+  }
 
-    good = good && writer->commit();
-    if (!good)
-      return false;
+  template<typename... Args>
+  bool common_try_log(const LogLevel logLevel, Args&&... args)
+  {
+    if (logLevel < m_minLevel.load(std::memory_order::relaxed))
+      return true;
 
-    m_bytesAvailible.fetch_sub(writer->bytes_written(), std::memory_order::acq_rel);
-    m_bytesAvailible.notify_one();
-    return true;
+    return counted_try_log(logLevel, Clock::now(), std::forward<Args>(args)...);
   }
 
+  // Like reporting_try_log, but counts the line as dropped if it doesn't fit.
   template<typename... Args>
-  bool internal_try_log(const LogLevel logLevel,
-                        fmt::format_string<typename SmartSerializer<Args>::serialized_type...>&& fmt,
-                        Args&&... args)
-  {
-    // Notice the + here, it forces the lambda to become a function pointer.
-    auto trampoline = +[](ByteBuffer::Reader& reader, Sink& sink) {
-      LogLevel level;
-      if (!read_from_buffer<LogLevel>(reader, level))
-        return false;
-
-      std::string st;
-      if (!read_from_buffer<decltype(fmt.get())>(reader, st))
-        return false;
-
-      // not using an optional because your interface effectively requires default constructibility anyway
-      std::tuple<typename SmartSerializer<Args>::serialized_type...> results;
-      const bool success = [&results, &reader]<std::size_t... Is>(std::index_sequence<Is...>) {
-        return (... and read_from_buffer<Args>(reader, std::get<Is>(results)));
-      }(std::index_sequence_for<Args...>{});
-
-      if (!success)
-        return false;
-
-      // Simpler version, if we cannot have errors;
-      // auto results = std::tuple{ read_from_buffer<Buffer, Args>(buffer)... };
-      auto logLine =
-        std::apply([&st](auto&&... ts) { return fmt::vformat(st, fmt::make_format_args(ts...)); }, results);
-
-      sink.receive(level, std::chrono::system_clock::now(), logLine);
+  bool counted_try_log(const LogLevel logLevel, const std::uint64_t timestamp, Args&&... args)
+  {
+    if (reporting_try_log(logLevel, timestamp, std::forward<Args>(args)...) == detail::WriteResult::Written) [[likely]]
       return true;
-    };
 
-    const auto writer = m_buffer->get_writer();
+    m_dropped[static_cast<std::size_t>(logLevel)]++;
+    m_unreported[static_cast<std::size_t>(logLevel)]++;
+    m_hasUnreported = true;
+    return false;
+  }
 
-    bool good = write_to_buffer(*writer, trampoline);
-    good = good && write_to_buffer(*writer, logLevel);
-    good = good && write_to_buffer(*writer, fmt.get());
-    good = good && (... and (write_to_buffer(*writer, std::forward<Args>(args))));
+  // Logs the line, after telling the consumer about any lines dropped before it.
+  template<typename... Args>
+  detail::WriteResult reporting_try_log(const LogLevel logLevel, const std::uint64_t timestamp, Args&&... args)
+  {
+    if (m_hasUnreported) [[unlikely]] {
+      if (!report_dropped(timestamp))
+        return detail::WriteResult::Full;
+    }
 
-    if (m_maxMessageSize < writer->bytes_written())
-      return false;
+    return internal_try_log(logLevel, timestamp, std::forward<Args>(args)...);
+  }
 
-    good = good && writer->commit();
-    if (!good)
+  bool report_dropped(const std::uint64_t timestamp)
+  {
+    using namespace literals;
+
+    const auto& counts = m_unreported;
+    std::uint64_t total = 0;
+    for (const auto count : counts)
+      total += count;
+
+    if (internal_try_log(LogLevel::Warn,
+                         timestamp,
+                         "{} log lines were dropped, as they didn't fit in the buffer: {} trace, {} debug, {} info, "
+                         "{} warn, {} error, {} critical"_fmt,
+                         total,
+                         counts[0],
+                         counts[1],
+                         counts[2],
+                         counts[3],
+                         counts[4],
+                         counts[5]) != detail::WriteResult::Written)
       return false;
 
-    m_bytesAvailible.fetch_sub(writer->bytes_written(), std::memory_order::acq_rel);
-    m_bytesAvailible.notify_one();
+    m_unreported = {};
+    m_hasUnreported = false;
     return true;
   }
+
+  template<auto S, typename... Args>
+  detail::WriteResult internal_try_log(const LogLevel logLevel,
+                                       const std::uint64_t timestamp,
+                                       FormatString<S>,
+                                       Args&&... args)
+  {
+    const auto site =
+      detail::visit_level(logLevel, []<LogLevel Level>() { return &s_compiledSite<Level, S, Args...>; });
+
+    return write_message(message_size(site, timestamp, args...), [&](auto& writer) {
+      bool good = write_to_buffer(writer, site);
+      good = good && write_to_buffer(writer, timestamp);
+      good = good && (... and (write_to_buffer(writer, std::forward<Args>(args))));
+      return good;
+    });
+  }
+
+  template<const StaticLogSite* Site, typename... Args>
+  detail::WriteResult internal_try_log(const LogLevel,
+                                       const std::uint64_t timestamp,
+                                       detail::StaticSiteFormat<Site>,
+                                       Args&&... args)
+  {
+    const auto site = &s_staticSite<Site, Args...>;
+    return write_message(message_size(site, timestamp, args...), [&](auto& writer) {
+      bool good = write_to_buffer(writer, site);
+      good = good && write_to_buffer(writer, timestamp);
+      good = good && (... and (write_to_buffer(writer, std::forward<Args>(args))));
+      return good;
+    });
+  }
+
+  template<typename... Args>
+  detail::WriteResult internal_try_log(const LogLevel logLevel,
+                                       const std::uint64_t timestamp,
+                                       LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt,
+                                       Args&&... args)
+  {
+    const auto site = detail::visit_level(logLevel, []<LogLevel Level>() { return &s_runtimeSite<Level, Args...>; });
+    const auto format = fmt.get();
+    const auto formatData = static_cast<const void*>(format.data());
+
+    return write_message(message_size(site, timestamp, formatData, format.size(), args...), [&](auto& writer) {
+      bool good = write_to_buffer(writer, site);
+      good = good && write_to_buffer(writer, timestamp);
+      good = good && write_to_buffer(writer, formatData);
+      good = good && write_to_buffer(writer, format.size());
+      good = good && (... and (write_to_buffer(writer, std::forward<Args>(args))));
+      return good;
+    });
+  }
 };
 } // namespace hage
\ No newline at end of file
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <hage/core/misc.hpp>
+
+#include "byte_buffer.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
+
+#if defined(__linux__)
+#define HAGE_HAS_MIRRORED_RING_BUFFER 1
+#else
+#define HAGE_HAS_MIRRORED_RING_BUFFER 0
+#endif
+
+#if HAGE_HAS_MIRRORED_RING_BUFFER
+namespace hage {
+
+/**
+ * A @{ByteBuffer} that maps the same pages twice, back to back, in virtual memory. Any read or write of at most
+ * `capacity()` bytes starting inside the buffer is therefore contiguous, and there is no wrap around handling at all.
+ * This also means records never need padding at the end of the buffer.
+ *
+ * The capacity is chosen at runtime, and is rounded up to a multiple of the page size. Only available on linux.
+ */
+class MirroredRingBuffer final : public ByteBuffer
+{
+  // The head and tail are the total number of bytes read and written, so they never wrap.
+  using index_type = std::uint64_t;
+  using record_header = std::uint32_t;
+
+  alignas(detail::destructive_interference_size) std::atomic<index_type> m_head{ 0 };
+  alignas(detail::destructive_interference_size) index_type m_cachedHead{ 0 };
+
+  alignas(detail::destructive_interference_size) std::atomic<index_type> m_tail{ 0 };
+  alignas(detail::destructive_interference_size) index_type m_cachedTail{ 0 };
+
+  alignas(detail::destructive_interference_size) std::byte* m_data{ nullptr };
+  std::size_t m_capacity{ 0 };
+
+#if HAGE_DEBUG
+  alignas(detail::destructive_interference_size) std::atomic_flag m_hasReader;
+  alignas(detail::destructive_interference_size) std::atomic_flag m_hasWriter;
+#endif
+
+public:
+  class Reader final : public ByteBuffer::Reader
+  {
+  public:
+    explicit Reader(MirroredRingBuffer& parent) : m_parent{ parent }
+    {
+#if HAGE_DEBUG
+      if (m_parent.m_hasReader.test_and_set(std::memory_order::acq_rel))
+        throw std::runtime_error("We can only have one concurrent reader for MirroredRingBuffer");
+#endif
+
+      m_shadowHead = m_parent.m_head.load(std::memory_order::relaxed);
+      m_offset = m_shadowHead % m_parent.m_capacity;
+    }
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+#if HAGE_DEBUG
+    ~Reader() override { m_parent.m_hasReader.clear(std::memory_order::release); }
+#endif
+
+    bool read(std::span<std::byte> dst) override
+    {
+      if (!readable(dst.size_bytes()))
+        return false;
+
+      std::memcpy(dst.data(), m_parent.m_data + m_offset, dst.size_bytes());
+      advance(dst.size_bytes());
+      return true;
+    }
+
+    bool commit() override
+    {
+      m_parent.m_head.store(m_shadowHead, std::memory_order::release);
+      return true;
+    }
+
+    [[nodiscard]] std::size_t bytes_read() const override { return m_bytesRead; }
+
+    /**
+     * Returns the next record committed with Writer::commit(used), as a contiguous span into the buffer. The span is
+     * valid until this reader is committed. Returns an empty span if there are no records.
+     */
+    [[nodiscard]] std::span<const std::byte> read_record()
+    {
+      if (!readable(sizeof(record_header)))
+        return {};
+
+      record_header size;
+      std::memcpy(&size, m_parent.m_data + m_offset, sizeof(record_header));
+      advance(sizeof(record_header));
+
+      const auto record = std::span<const std::byte>(m_parent.m_data + m_offset, size);
+      advance(size);
+      return record;
+    }
+
+  private:
+    [[nodiscard]] bool readable(const std::size_t n)
+    {
+      if (m_parent.m_cachedTail - m_shadowHead < n) {
+        m_parent.m_cachedTail = m_parent.m_tail.load(std::memory_order::acquire);
+        if (m_parent.m_cachedTail - m_shadowHead < n)
+          return false;
+      }
+      return true;
+    }
+
+    void advance(const std::size_t n)
+    {
+      m_shadowHead += n;
+      m_bytesRead += n;
+      m_offset += n;
+      if (m_parent.m_capacity <= m_offset)
+        m_offset -= m_parent.m_capacity;
+    }
+
+    MirroredRingBuffer& m_parent;
+    index_type m_shadowHead;
+    std::size_t m_offset;
+    std::size_t m_bytesRead{ 0 };
+  };
+
+  class Writer final : public ByteBuffer::Writer
+  {
+  public:
+    explicit Writer(MirroredRingBuffer& parent) : m_parent{ parent }
+    {
+#if HAGE_DEBUG
+      if (m_parent.m_hasWriter.test_and_set(std::memory_order::acq_rel))
+        throw std::runtime_error("We can only have one concurrent writer for MirroredRingBuffer");
+#endif
+
+      m_shadowTail = m_parent.m_tail.load(std::memory_order::relaxed);
+      m_offset = m_shadowTail % m_parent.m_capacity;
+    }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+#if HAGE_DEBUG
+    ~Writer() override { m_parent.m_hasWriter.clear(std::memory_order::release); }
+#endif
+
+    bool write(std::span<const std::byte> src) override
+    {
+      if (!writable(src.size_bytes()))
+        return false;
+
+      std::memcpy(m_parent.m_data + m_offset, src.data(), src.size_bytes());
+      advance(src.size_bytes());
+      return true;
+    }
+
+    bool commit() override
+    {
+      m_parent.m_tail.store(m_shadowTail, std::memory_order::release);
+      return true;
+    }
+
+    [[nodiscard]] std::size_t bytes_written() const override { return m_bytesWritten; }
+
+    /**
+     * Reserves a contiguous region of n bytes in the buffer. Nothing is visible to the reader before the reservation
+     * is finished with commit(used). A new reservation replaces the previous uncommitted one.
+     *
+     * @return The reserved region, or an empty span if there is not enough room.
+     */
+    [[nodiscard]] std::span<std::byte> reserve(const std::size_t n)
+    {
+      m_reservedSize = 0;
+      if (n == 0 || std::numeric_limits<record_header>::max() < n || !writable(sizeof(record_header) + n))
+        return {};
+
+      m_reservedSize = n;
+      return { m_parent.m_data + m_offset + sizeof(record_header), n };
+    }
+
+    /**
+     * Finishes the last reservation, with only the first `used` bytes of it, and publishes it to the reader.
+     */
+    bool commit(const std::size_t used)
+    {
+      if (used == 0 || m_reservedSize < used)
+        return false;
+
+      const auto size = static_cast<record_header>(used);
+      std::memcpy(m_parent.m_data + m_offset, &size, sizeof(record_header));
+      advance(sizeof(record_header) + used);
+
+      m_reservedSize = 0;
+      return commit();
+    }
+
+  private:
+    [[nodiscard]] bool writable(const std::size_t n)
+    {
+      if (m_parent.m_capacity - (m_shadowTail - m_parent.m_cachedHead) < n) {
+        m_parent.m_cachedHead = m_parent.m_head.load(std::memory_order::acquire);
+        if (m_parent.m_capacity - (m_shadowTail - m_parent.m_cachedHead) < n)
+          return false;
+      }
+      return true;
+    }
+
+    void advance(const std::size_t n)
+    {
+      m_shadowTail += n;
+      m_bytesWritten += n;
+      m_offset += n;
+      if (m_parent.m_capacity <= m_offset)
+        m_offset -= m_parent.m_capacity;
+    }
+
+    MirroredRingBuffer& m_parent;
+    index_type m_shadowTail;
+    std::size_t m_offset;
+    std::size_t m_bytesWritten{ 0 };
+    std::size_t m_reservedSize{ 0 };
+  };
+
+  /**
+   * @param minCapacity The minimum number of bytes the buffer should hold, rounded up to a multiple of the page size.
+   * @throws std::system_error if the memory could not be mapped.
+   */
+  explicit MirroredRingBuffer(std::size_t minCapacity);
+  ~MirroredRingBuffer() override;
+
+  // We don't want copying
+  MirroredRingBuffer(const MirroredRingBuffer&) = delete;
+  MirroredRingBuffer& operator=(const MirroredRingBuffer&) = delete;
+
+  // We don't want moving either.
+  MirroredRingBuffer(MirroredRingBuffer&&) = delete;
+  MirroredRingBuffer& operator=(MirroredRingBuffer&&) = delete;
+
+  [[nodiscard]] std::unique_ptr<ByteBuffer::Reader> get_reader() override { return std::make_unique<Reader>(*this); }
+  [[nodiscard]] std::unique_ptr<ByteBuffer::Writer> get_writer() override { return std::make_unique<Writer>(*this); }
+
+  [[nodiscard]] Reader reader() { return Reader(*this); }
+  [[nodiscard]] Writer writer() { return Writer(*this); }
+
+  [[nodiscard]] std::size_t capacity() override { return m_capacity; }
+
+  /**
+   * The largest reservation that is guaranteed to succeed when the buffer is empty. As records never wrap, this is
+   * everything except the record header.
+   */
+  [[nodiscard]] std::size_t max_reservation() const { return m_capacity - sizeof(record_header); }
+};
+
+} // namespace hage
+#endif
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "logger.hpp"
+#include "ring_buffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace hage {
+
+/**
+ * Multiple producer, single consumer logger.
+ *
+ * Every thread that logs through it lazily gets its own Logger and buffer the first time it logs, so producers never
+ * share anything but read only state, and logging stays wait-free after that first call. A single consumer thread
+ * polls all the buffers with try_read_logs or drain. When a producer thread exits, its buffer is drained and freed by
+ * the consumer.
+ *
+ * There is no ordering between lines from different threads.
+ *
+ * @tparam Buffer The buffer each producer thread gets, it has to be default constructible.
+ * @tparam Clock The clock the producers timestamp each line with.
+ */
+template<typename Buffer = RingBuffer<1 << 16>, LogClock Clock = SystemClock>
+  requires StaticByteBuffer<Buffer> && std::default_initializable<Buffer>
+class MultiProducerLogger final : public LogFunctions<MultiProducerLogger<Buffer, Clock>>
+{
+public:
+  explicit MultiProducerLogger(Sink* sink,
+                               const std::size_t maxMessageSize = 1000,
+                               const OverflowPolicy overflowPolicy = OverflowPolicy::Block)
+    : m_sink{ sink }
+    , m_maxMessageSize{ maxMessageSize }
+    , m_overflowPolicy{ overflowPolicy }
+  {
+  }
+
+  // The producers refer to us by id, so we can't be copied or moved.
+  MultiProducerLogger(const MultiProducerLogger&) = delete;
+  MultiProducerLogger& operator=(const MultiProducerLogger&) = delete;
+
+  void set_min_log_level(const LogLevel level)
+  {
+    std::scoped_lock lock(m_mutex);
+    m_minLevel.store(level, std::memory_order::relaxed);
+    for (const auto& producer : m_producers)
+      producer->logger.set_min_log_level(level);
+  }
+
+  [[nodiscard]] bool should_log(const LogLevel level) const
+  {
+    return m_minLevel.load(std::memory_order::relaxed) <= level;
+  }
+
+  /**
+   * Makes every producer, including the ones that register later, notify `signal` after each message.
+   */
+  void set_consumer_signal(ConsumerSignal* signal)
+  {
+    std::scoped_lock lock(m_mutex);
+    m_consumerSignal = signal;
+    for (const auto& producer : m_producers)
+      producer->logger.set_consumer_signal(signal);
+  }
+
+  /**
+   * Reads up to `maxRecords` log lines from each of the producers, without waiting. Must only be called from one thread
+   * at a time.
+   *
+   * @return The number of log lines read.
+   */
+  std::size_t try_read_logs(const std::size_t maxRecords)
+  {
+    refresh_producers();
+
+    std::size_t records = 0;
+    for (const auto& producer : m_polled) {
+      // We have to check this before reading, so we know nothing is written after our last read.
+      if (producer->retired.load(std::memory_order::acquire)) {
+        records += producer->logger.drain();
+        m_drained.push_back(producer.get());
+      } else {
+        records += producer->logger.try_read_logs(maxRecords);
+      }
+    }
+
+    if (!m_drained.empty())
+      remove_drained_producers();
+
+    return records;
+  }
+
+  /**
+   * Reads all the log lines that are currently in the buffers.
+   *
+   * @return The number of log lines read.
+   */
+  std::size_t drain() { return try_read_logs(std::numeric_limits<std::size_t>::max()); }
+
+  /**
+   * Tells the sink that there is nothing to read, so it can write out lines it has held on to for too long. Must be
+   * called from the thread that reads.
+   */
+  void on_idle(const Sink::timestamp_type& now) { m_sink->on_idle(now); }
+
+  /**
+   * The number of producer threads that currently have a buffer.
+   */
+  [[nodiscard]] std::size_t producers() const
+  {
+    std::scoped_lock lock(m_mutex);
+    return m_producers.size();
+  }
+
+  template<typename... Args>
+  void log(const LogLevel logLevel,
+           LogFormatString<typename SmartSerializer<Args>::serialized_type...> fmt,
+           Args&&... args)
+  {
+    local_logger().log(logLevel, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+  }
+
+  template<auto S, typename... Args>
+  void log(const LogLevel logLevel, FormatString<S>&& f, Args&&... args)
+  {
+    local_logger().log(logLevel, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+  }
+
+  template<typename... Args>
+  bool try_log(const LogLevel logLevel,
+               LogFormatString<typename SmartSerializer<Args>::serialized_type...>&& fmt,
+               Args&&... args)
+  {
+    return local_logger().try_log(logLevel, std::forward<decltype(fmt)>(fmt), std::forward<Args>(args)...);
+  }
+
+  template<auto S, typename... Args>
+  bool try_log(const LogLevel logLevel, FormatString<S>&& f, Args&&... args)
+  {
+    return local_logger().try_log(logLevel, std::forward<FormatString<S>>(f), std::forward<Args>(args)...);
+  }
+
+  // See Logger::log_at.
+  template<const StaticLogSite* Site, typename... Args>
+  void log_at(Args&&... args)
+  {
+    local_logger().template log_at<Site>(std::forward<Args>(args)...);
+  }
+
+  template<const StaticLogSite* Site, typename... Args>
+  bool try_log_at(Args&&... args)
+  {
+    return local_logger().template try_log_at<Site>(std::forward<Args>(args)...);
+  }
+
+private:
+  struct Producer
+  {
+    Producer(Sink* sink, const std::size_t maxMessageSize)
+      : logger(&buffer, sink, maxMessageSize)
+    {
+    }
+
+    Buffer buffer;
+    Logger<Buffer, Clock> logger;
+
+    // Set when the producer thread exits, after which it never writes to the buffer again.
+    std::atomic<bool> retired{ false };
+  };
+
+  // The producers of the current thread, one for each logger it has logged to.
+  struct ThreadState
+  {
+    std::uint64_t cachedId{ 0 };
+    Logger<Buffer, Clock>* cachedLogger{ nullptr };
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<Producer>>> producers;
+
+    ~ThreadState()
+    {
+      for (const auto& [id, producer] : producers)
+        producer->retired.store(true, std::memory_order::release);
+    }
+  };
+
+  inline static std::atomic<std::uint64_t> s_nextId{ 1 };
+  inline static thread_local ThreadState s_threadState;
+
+  const std::uint64_t m_id{ s_nextId.fetch_add(1, std::memory_order::relaxed) };
+  Sink* m_sink;
+  std::size_t m_maxMessageSize;
+  OverflowPolicy m_overflowPolicy;
+
+  // Guards the registered producers and the log level. Only taken when a thread logs for the first time, when the set
+  // of producers changes and when the log level is set.
+  mutable std::mutex m_mutex;
+  std::vector<std::shared_ptr<Producer>> m_producers;
+  // Only written under the mutex, but read without it by should_log.
+  std::atomic<LogLevel> m_minLevel{ LogLevel::Info };
+  ConsumerSignal* m_consumerSignal{ nullptr };
+  std::atomic<std::uint64_t> m_generation{ 0 };
+
+  // The consumers copy of the producers, so it doesn't have to lock for each poll.
+  std::vector<std::shared_ptr<Producer>> m_polled;
+  std::uint64_t m_polledGeneration{ 0 };
+  std::vector<Producer*> m_drained;
+
+  Logger<Buffer, Clock>& local_logger()
+  {
+    auto& state = s_threadState;
+    if (state.cachedId == m_id) [[likely]]
+      return *state.cachedLogger;
+
+    return register_thread(state);
+  }
+
+  Logger<Buffer, Clock>& register_thread(ThreadState& state)
+  {
+    auto it = std::ranges::find(state.producers, m_id, &decltype(state.producers)::value_type::first);
+    if (it == state.producers.end()) {
+      // If we are the only owner left, the logger it belonged to is gone, so we can free it.
+      std::erase_if(state.producers, [](const auto& entry) { return entry.second.use_count() == 1; });
+
+      auto producer = std::make_shared<Producer>(m_sink, m_maxMessageSize);
+      // We are on the producer thread, which is the only one that reads the policy.
+      producer->logger.set_overflow_policy(m_overflowPolicy);
+      {
+        std::scoped_lock lock(m_mutex);
+        producer->logger.set_min_log_level(m_minLevel.load(std::memory_order::relaxed));
+        producer->logger.set_consumer_signal(m_consumerSignal);
+        m_producers.push_back(producer);
+        // seq_cst, so a consumer parking on a ConsumerSignal sees the new producer before its first message.
+        m_generation.fetch_add(1, std::memory_order::seq_cst);
+      }
+
+      state.producers.emplace_back(m_id, std::move(producer));
+      it = std::prev(state.producers.end());
+    }
+
+    state.cachedId = m_id;
+    state.cachedLogger = &it->second->logger;
+    return *state.cachedLogger;
+  }
+
+  void refresh_producers()
+  {
+    if (m_generation.load(std::memory_order::seq_cst) == m_polledGeneration)
+      return;
+
+    std::scoped_lock lock(m_mutex);
+    m_polled = m_producers;
+    m_polledGeneration = m_generation.load(std::memory_order::relaxed);
+  }
+
+  void remove_drained_producers()
+  {
+    const auto wasDrained = [this](const auto& producer) {
+      return std::ranges::find(m_drained, producer.get()) != m_drained.end();
+    };
+
+    {
+      std::scoped_lock lock(m_mutex);
+      std::erase_if(m_producers, wasDrained);
+    }
+
+    std::erase_if(m_polled, wasDrained);
+    m_drained.clear();
+  }
+};
+
+} // namespace hage
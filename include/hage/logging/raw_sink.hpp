@@ -0,0 +1,61 @@
+#pragma once
+
+#include "serializers.hpp"
+#include "sink.hpp"
+
+#include <cstddef>
+#include <source_location>
+#include <span>
+#include <string_view>
+
+namespace hage {
+
+/**
+ * What is known about a log statement before it is ever logged. Each statement has one of these as a static, so its
+ * address can be used to tell statements apart.
+ */
+struct LogSiteInfo
+{
+  LogLevel level;
+
+  // Empty when the format string is only known when logging, in which case it follows the pointer in the buffer.
+  std::string_view format;
+  std::source_location location;
+  std::span<const ArgumentType> arguments;
+
+  // If all the arguments can be decoded without their types, so the line can be formatted later.
+  [[nodiscard]] constexpr bool describable() const
+  {
+    for (const auto type : arguments) {
+      if (type == ArgumentType::Unsupported)
+        return false;
+    }
+    return true;
+  }
+};
+
+/**
+ * A log line that has not been formatted.
+ */
+struct RawRecord
+{
+  const LogSiteInfo* site;
+  // The sites format string, or the one passed when logging for runtime format strings.
+  std::string_view format;
+  Sink::timestamp_type ts;
+  // The arguments, as written by their Serializer, back to back.
+  std::span<const std::byte> arguments;
+};
+
+/**
+ * A sink that would rather store the arguments than the formatted line. When a logger is given one, it passes the lines
+ * it reads to receive_raw without formatting them. Lines with arguments that aren't describable are still formatted
+ * and passed to receive.
+ */
+class RawSink : public Sink
+{
+public:
+  virtual void receive_raw(const RawRecord& record) = 0;
+};
+
+} // namespace hage
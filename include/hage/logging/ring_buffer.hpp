@@ -5,6 +5,8 @@
 
 #include "byte_buffer.hpp"
 
+#include <cstdint>
+#include <limits>
 #include <span>
 
 namespace hage {
@@ -23,6 +25,12 @@ template<std::size_t N>
 class RingBuffer final : public ByteBuffer
 {
   using index_type = std::size_t;
+
+  // Records are stored as a header holding the length, followed by the payload. When a record doesn't fit before the
+  // end of the buffer, a header with the skip marker is written in its place and the record starts at 0 instead. If
+  // there isn't even room for a header, the skip is implied.
+  using record_header = std::uint32_t;
+  static constexpr record_header skip_marker = std::numeric_limits<record_header>::max();
   alignas(detail::destructive_interference_size) std::atomic<index_type> m_head{ 0 };
   alignas(detail::destructive_interference_size) index_type m_cachedHead{ 0 };
 
@@ -36,6 +44,7 @@ class RingBuffer final : public ByteBuffer
   alignas(detail::destructive_interference_size) std::atomic_flag m_hasWriter;
 #endif
 
+public:
   class Reader final : public ByteBuffer::Reader
   {
   public:
@@ -50,6 +59,9 @@ class RingBuffer final : public ByteBuffer
       m_shadowHead = m_parent.m_head.load(std::memory_order::relaxed);
     }
 
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
 #if HAGE_DEBUG
     ~Reader() override { m_parent.m_hasReader.clear(std::memory_order::release); }
 #endif
@@ -109,6 +121,43 @@ class RingBuffer final : public ByteBuffer
     }
     [[nodiscard]] std::size_t bytes_read() const override { return m_bytesRead; }
 
+    /**
+     * Returns the next record committed with Writer::commit(used), as a contiguous span into the buffer. The span is
+     * valid until this reader is committed. Returns an empty span if there are no records.
+     */
+    [[nodiscard]] std::span<const std::byte> read_record()
+    {
+      auto head = m_shadowHead;
+      if (head == m_parent.m_cachedTail) {
+        m_parent.m_cachedTail = m_parent.m_tail.load(std::memory_order::acquire);
+        if (head == m_parent.m_cachedTail)
+          return {};
+      }
+
+      record_header size;
+      if (N + 1 - head < sizeof(record_header)) {
+        size = skip_marker;
+      } else {
+        std::memcpy(&size, m_parent.m_buff.data() + head, sizeof(record_header));
+      }
+
+      if (size == skip_marker) {
+        m_bytesRead += N + 1 - head;
+        head = 0;
+        std::memcpy(&size, m_parent.m_buff.data(), sizeof(record_header));
+      }
+
+      const auto record = std::span<const std::byte>(m_parent.m_buff.data() + head + sizeof(record_header), size);
+
+      head += sizeof(record_header) + size;
+      if (head == N + 1)
+        head = 0;
+
+      m_bytesRead += sizeof(record_header) + size;
+      m_shadowHead = head;
+      return record;
+    }
+
   private:
     RingBuffer& m_parent;
     index_type m_shadowHead;
@@ -128,6 +177,9 @@ class RingBuffer final : public ByteBuffer
       m_shadowTail = m_parent.m_tail.load(std::memory_order::relaxed);
     }
 
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
 #if HAGE_DEBUG
     ~Writer() override { m_parent.m_hasWriter.clear(std::memory_order::release); }
 #endif
@@ -188,13 +240,86 @@ class RingBuffer final : public ByteBuffer
     }
     [[nodiscard]] std::size_t bytes_written() const override { return m_bytesWritten; }
 
+    /**
+     * Reserves a contiguous region of n bytes in the buffer. Nothing is visible to the reader before the reservation
+     * is finished with commit(used). A new reservation replaces the previous uncommitted one.
+     *
+     * @return The reserved region, or an empty span if there is not enough room.
+     */
+    [[nodiscard]] std::span<std::byte> reserve(const std::size_t n)
+    {
+      m_reservedSize = 0;
+      m_reservedPadding = 0;
+      if (n == 0 || skip_marker <= n || N < sizeof(record_header) + n)
+        return {};
+
+      const auto total = sizeof(record_header) + n;
+      auto tail = m_shadowTail;
+
+      if (contiguous_free(tail) < total) {
+        m_parent.m_cachedHead = m_parent.m_head.load(std::memory_order::acquire);
+        if (contiguous_free(tail) < total) {
+          // We can only wrap when we are in front of the reader, and there is space at the start.
+          const auto head = m_parent.m_cachedHead;
+          if (tail < head || head <= total)
+            return {};
+
+          if (sizeof(record_header) <= N + 1 - tail)
+            std::memcpy(m_parent.m_buff.data() + tail, &skip_marker, sizeof(record_header));
+
+          m_reservedPadding = N + 1 - tail;
+          tail = 0;
+        }
+      }
+
+      m_reservedAt = tail;
+      m_reservedSize = n;
+      return { m_parent.m_buff.data() + tail + sizeof(record_header), n };
+    }
+
+    /**
+     * Finishes the last reservation, with only the first `used` bytes of it, and publishes it to the reader.
+     */
+    bool commit(const std::size_t used)
+    {
+      if (used == 0 || m_reservedSize < used)
+        return false;
+
+      const auto size = static_cast<record_header>(used);
+      std::memcpy(m_parent.m_buff.data() + m_reservedAt, &size, sizeof(record_header));
+
+      auto tail = m_reservedAt + sizeof(record_header) + used;
+      if (tail == N + 1)
+        tail = 0;
+
+      m_bytesWritten += m_reservedPadding + sizeof(record_header) + used;
+      m_shadowTail = tail;
+      m_reservedSize = 0;
+      return commit();
+    }
+
   private:
+    // The number of bytes we can write starting at tail, without wrapping or running into the head.
+    [[nodiscard]] std::size_t contiguous_free(const index_type tail) const
+    {
+      const auto head = m_parent.m_cachedHead;
+      if (tail < head)
+        return head - tail - 1;
+      else if (head == 0)
+        return N - tail;
+      else
+        return N + 1 - tail;
+    }
+
     RingBuffer& m_parent;
     index_type m_shadowTail;
     std::size_t m_bytesWritten{ 0 };
+
+    index_type m_reservedAt{ 0 };
+    std::size_t m_reservedSize{ 0 };
+    std::size_t m_reservedPadding{ 0 };
   };
 
-public:
   RingBuffer() = default;
   ~RingBuffer() override = default;
 
@@ -209,7 +334,21 @@ public:
   [[nodiscard]] std::unique_ptr<ByteBuffer::Reader> get_reader() override { return std::make_unique<Reader>(*this); }
   [[nodiscard]] std::unique_ptr<ByteBuffer::Writer> get_writer() override { return std::make_unique<Writer>(*this); }
 
+  // These are the allocation free versions of the above, used when the buffer type is known at compile time.
+  [[nodiscard]] Reader reader() { return Reader(*this); }
+  [[nodiscard]] Writer writer() { return Writer(*this); }
+
   [[nodiscard]] std::size_t capacity() override { return N; }
+
+  /**
+   * The largest reservation that is guaranteed to succeed when the buffer is empty, regardless of where in the
+   * buffer the reader and writer currently are.
+   */
+  [[nodiscard]] static constexpr std::size_t max_reservation()
+  {
+    constexpr auto half = (N + 1) / 2;
+    return half < sizeof(record_header) ? 0 : half - sizeof(record_header);
+  }
 };
 #if defined(_MSC_VER)
 #pragma warning(pop)
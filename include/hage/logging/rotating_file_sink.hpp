@@ -2,10 +2,21 @@
 
 #include "file_sink.hpp"
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <functional>
-
-#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/chrono.h>
+#include <fmt/os.h>
 #include <hage/core/concepts.hpp>
 
 #include "sink.hpp"
@@ -15,6 +26,8 @@ namespace hage {
 struct LogFileStats final
 {
   std::size_t bytes;
+  // The timestamp of the last line written, so rotaters don't have to read the clock.
+  Sink::timestamp_type ts{};
 };
 
 class Rotater
@@ -29,6 +42,16 @@ public:
   virtual ~Rotater() = default;
 
   [[nodiscard]] virtual bool shouldRotate(const LogFileStats& stats) = 0;
+
+  /**
+   * The first size or timestamp, whichever is reached first, at which shouldRotate might say yes. The sink passes the
+   * lines before it on in one go, and only asks shouldRotate at that point. The default is reached by every line, so
+   * shouldRotate is asked after each of them.
+   */
+  [[nodiscard]] virtual LogFileStats nextRotation() const { return { .bytes = 0, .ts = Sink::timestamp_type::min() }; }
+
+  // Up to `times` file names, newest first, where the first is the one to write to next. With MoveBackwards every file
+  // is moved one name back, and the last one falls off. With RemoveLast the last one is removed, if there are `times`.
   [[nodiscard]] virtual std::vector<std::filesystem::path> generateNames(const LogFileStats& stats, int times) = 0;
   [[nodiscard]] virtual Type getRotateType() const = 0;
 
@@ -43,13 +66,28 @@ protected:
   Rotater(Rotater&&) = default;
 };
 
+/**
+ * A file sink that moves on to a new file when its Rotater says so. The renaming and removing of old files happens on a
+ * background thread, which also opens the next file ahead of time, so rotating only swaps the file on the log thread.
+ * The log thread only waits if it rotates again before the background thread has caught up.
+ *
+ * If the background thread fails, the error is thrown from the next rotation or flush, and the sink carries on. A file
+ * that couldn't be renamed is left under the hidden name it was prepared with.
+ */
 class RotatingFileSink final : public Sink
 {
 public:
   struct Config final
   {
     std::filesystem::path saveDirectory;
+    // The number of files kept, including the one being written to.
     int maxNumber{ -1 };
+    // Space reserved in the next file while it waits, so writing to it doesn't allocate. Zero turns this off.
+    std::size_t preallocate{ 0 };
+    FileFlushPolicy policy{};
+    std::string pattern{ LinePattern::default_pattern };
+    // Used over a precision given in the pattern.
+    TimestampPrecision precision{ native_timestamp_precision };
 
     [[nodiscard]] bool valid() const
     {
@@ -62,21 +100,58 @@ public:
 
   void receive(LogLevel level, const timestamp_type& ts, std::string_view line) override;
 
+  // Passes the lines on in runs that end where the rotater might rotate, and only checks for rotation there. So a file
+  // never gets more than a line past the limit.
+  void receive_batch(std::span<const Record> records) override;
+
+  // Writes out the current file, if it has held on to a line for the max delay.
+  void on_idle(const timestamp_type& now) override;
+
   RotatingFileSink(Config conf, std::unique_ptr<Rotater> rotater);
 
+  // Flushes the current file, and waits for the background thread to finish what it has been given.
   void flush();
 
   ~RotatingFileSink() override;
 
 private:
+  // The next file is opened under a name of its own, and renamed when it is rotated in.
+  struct PreparedFile
+  {
+    fmt::file file;
+    std::filesystem::path path;
+  };
+
+  struct Rotation
+  {
+    fmt::file previous;
+    // Where the file that was rotated in is, until it is renamed to the first of the names.
+    std::filesystem::path current;
+    std::vector<std::filesystem::path> names;
+  };
+
   void rotate(const LogFileStats& stats);
+  PreparedFile take_prepared();
+
+  // These are run on the background thread, except when setting up.
+  void move_files(const std::vector<std::filesystem::path>& names) const;
+  [[nodiscard]] PreparedFile prepare_file() const;
+  void run(const std::stop_token& stop);
 
   Config m_conf;
   std::unique_ptr<Rotater> m_rotater;
 
-  // TODO(rHermes): Rework this, so that there exists a default constructable FileSink.
-  // this enables move semantics and so on.
   std::optional<FileSink> m_currentFile;
+
+  std::mutex m_mutex;
+  std::condition_variable_any m_changed;
+  std::deque<Rotation> m_rotations;
+  std::optional<PreparedFile> m_prepared;
+  std::exception_ptr m_error;
+  bool m_busy{ false };
+
+  // Last, so it is stopped before the rest is destroyed.
+  std::jthread m_worker;
 };
 
 class SizeRotater final : public Rotater
@@ -85,6 +160,10 @@ public:
   SizeRotater(std::filesystem::path base, std::size_t maxSize);
 
   [[nodiscard]] bool shouldRotate(const LogFileStats& stats) override;
+  [[nodiscard]] LogFileStats nextRotation() const override
+  {
+    return { .bytes = m_maxSize, .ts = Sink::timestamp_type::max() };
+  }
   [[nodiscard]] std::vector<std::filesystem::path> generateNames(const LogFileStats& stats, int times) override;
   [[nodiscard]] Type getRotateType() const override { return Type::MoveBackwards; };
 
@@ -95,19 +174,38 @@ private:
 
 /**
  * @short A rotater based on a timing string.
+ *
+ * Rotates every period, on multiples of it since midnight, going by the timestamps of the lines. Each file is named by
+ * formatting the start of its period with the format string, in the chosen time zone. The names of the files it has
+ * made are remembered, so the oldest can be removed.
+ *
+ * The next boundary is worked out when rotating, so checking for it is a single compare of the line's timestamp.
  */
 class TimeRotater final : public Rotater
 {
 public:
+  enum class Zone
+  {
+    Utc,
+    Local
+  };
+
   using fmt_string = fmt::format_string<std::chrono::system_clock::time_point>;
-  explicit TimeRotater(fmt_string base);
+  explicit TimeRotater(fmt_string base, std::chrono::seconds period = std::chrono::hours(24), Zone zone = Zone::Utc);
 
-  [[nodiscard]] bool shouldRotate(const LogFileStats& stats) override;
+  [[nodiscard]] bool shouldRotate(const LogFileStats& stats) override { return m_nextRotation <= stats.ts; }
+  [[nodiscard]] LogFileStats nextRotation() const override
+  {
+    return { .bytes = std::numeric_limits<std::size_t>::max(), .ts = m_nextRotation };
+  }
   [[nodiscard]] std::vector<std::filesystem::path> generateNames(const LogFileStats& stats, int times) override;
   [[nodiscard]] Type getRotateType() const override { return Type::RemoveLast; };
 
 private:
   fmt_string m_format;
+  std::chrono::seconds m_period;
+  Zone m_zone;
+  Sink::timestamp_type m_nextRotation{};
   std::vector<std::filesystem::path> m_previous;
 };
 } // namespace hage
@@ -2,10 +2,25 @@
 
 #include "byte_buffer.hpp"
 
+#include <fmt/chrono.h>
 #include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <fmt/std.h>
+
+#include <array>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <ranges>
 #include <span>
-#include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <variant>
 
 namespace hage {
 namespace details {
@@ -34,69 +49,520 @@ singular_writable_bytes(T& t)
 template<typename T, typename = void>
 struct Serializer;
 
-// This is a constrcut that is used to limit the amount of template expansions that happen
+// This is a constrcut that is used to limit the amount of template expansions that happen. References and const are
+// stripped as well, so the serializers only have to be specialized for plain types.
 template<typename T>
-using SmartSerializer =
-  std::conditional_t<std::is_convertible_v<T, fmt::string_view>, Serializer<fmt::string_view>, Serializer<T>>;
+using SmartSerializer = std::conditional_t<std::is_convertible_v<T, fmt::string_view>,
+                                           Serializer<fmt::string_view>,
+                                           Serializer<std::remove_cvref_t<T>>>;
 
-// These are convinience functions.
-template<typename T>
+// These are convinience functions. They are templated on the reader and writer, so that when the concrete buffer
+// type is known, the calls into it can be resolved at compile time.
+template<ByteWriter Writer, typename T>
 bool
-write_to_buffer(ByteBuffer::Writer& writer, T&& src)
+write_to_buffer(Writer& writer, T&& src)
 {
   return SmartSerializer<T>::to_bytes(writer, std::forward<T>(src));
 }
 
-template<typename T>
+template<typename T, ByteReader Reader>
 bool
-read_from_buffer(ByteBuffer::Reader& reader, typename SmartSerializer<T>::serialized_type& dst)
+read_from_buffer(Reader& reader, typename SmartSerializer<T>::serialized_type& dst)
 {
   return SmartSerializer<T>::from_bytes(reader, dst);
 }
 
-template<typename T>
+template<typename T, ByteReader Reader>
 typename SmartSerializer<T>::serialized_type
-read_from_buffer(ByteBuffer::Reader& reader)
+read_from_buffer(Reader& reader)
 {
   typename SmartSerializer<T>::serialized_type lel{};
   SmartSerializer<T>::from_bytes(reader, lel);
   return lel;
 }
 
+/**
+ * A serializer that can tell how many bytes a value takes up before writing it. This lets the logger check the size of
+ * a whole message, and reserve exactly that, without copying anything first. Types that always take up the same space
+ * give a constexpr `fixed_size`, others an `encoded_size(value)`.
+ */
+template<typename T>
+concept SizedSerializer = requires {
+  { SmartSerializer<T>::fixed_size } -> std::convertible_to<std::size_t>;
+} || requires(const std::remove_cvref_t<T>& value) {
+  { SmartSerializer<T>::encoded_size(value) } -> std::same_as<std::size_t>;
+};
+
+template<SizedSerializer T>
+constexpr std::size_t
+encoded_size(const T& value)
+{
+  if constexpr (requires { SmartSerializer<T>::fixed_size; })
+    return SmartSerializer<T>::fixed_size;
+  else
+    return SmartSerializer<T>::encoded_size(value);
+}
+
+/**
+ * A type that is written as its bytes, and read back as itself. Ranges of these are written with a single copy.
+ */
+template<typename T>
+concept BitwiseSerializable =
+  std::is_trivially_copyable_v<T> && std::same_as<typename SmartSerializer<T>::serialized_type, T> &&
+  requires { requires SmartSerializer<T>::fixed_size == sizeof(T); };
+
+namespace details {
+template<typename T>
+struct BytesSerializer
+{
+  using serialized_type = T;
+
+  static constexpr std::size_t fixed_size = sizeof(T);
+
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const T& val)
+  {
+    return writer.write(singular_bytes(val));
+  }
+
+  template<ByteReader Reader>
+  static bool from_bytes(Reader& reader, T& val)
+  {
+    return reader.read(singular_writable_bytes(val));
+  }
+};
+
+template<typename T>
+struct is_std_array : std::false_type
+{};
+
+template<typename T, std::size_t N>
+struct is_std_array<std::array<T, N>> : std::true_type
+{};
+} // namespace details
+
+template<typename T>
+struct Serializer<T, std::enable_if_t<std::is_scalar_v<T> && !std::is_enum_v<T>>> : details::BytesSerializer<T>
+{};
+
+/**
+ * Specialize this for a trivially copyable type, such as a plain struct of market data, to have the logger copy it as
+ * its bytes with a single memcpy. It is read back as itself on the logging thread, and formatted there with its own
+ * fmt::formatter, so it doesn't need a serializer of its own. The type shouldn't point to anything, as only the pointer
+ * would be copied.
+ *
+ *   template<>
+ *   struct hage::is_log_pod<Quote> : std::true_type
+ *   {};
+ */
 template<typename T>
-struct Serializer<T, std::enable_if_t<std::is_scalar_v<std::remove_cvref_t<T>>>>
+struct is_log_pod : std::false_type
+{};
+
+template<typename T>
+inline constexpr bool is_log_pod_v = is_log_pod<T>::value;
+
+template<typename T>
+struct Serializer<T, std::enable_if_t<is_log_pod_v<T>>> : details::BytesSerializer<T>
+{
+  static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be logged as their bytes");
+  static_assert(std::is_default_constructible_v<T>, "The logger needs to default construct a type to read it back");
+};
+
+// Enums are read back as themselves when fmt can format them, or they are marked as log pods, and as their underlying
+// type otherwise.
+template<typename T>
+struct Serializer<T, std::enable_if_t<std::is_enum_v<T> && !is_log_pod_v<T>>>
 {
-  using serialized_type = std::remove_cvref_t<T>;
+  using serialized_type = std::conditional_t<fmt::is_formattable<T>::value, T, std::underlying_type_t<T>>;
 
-  static bool to_bytes(ByteBuffer::Writer& writer, const T& val) { return writer.write(details::singular_bytes(val)); };
+  static constexpr std::size_t fixed_size = sizeof(serialized_type);
 
-  static bool from_bytes(ByteBuffer::Reader& reader, serialized_type& val)
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const T& val)
+  {
+    const auto serialized = static_cast<serialized_type>(val);
+    return writer.write(details::singular_bytes(serialized));
+  }
+
+  template<ByteReader Reader>
+  static bool from_bytes(Reader& reader, serialized_type& val)
   {
     return reader.read(details::singular_writable_bytes(val));
   }
 };
 
+// Strings are read back as views into the reader, so the consumer doesn't have to allocate them.
 template<typename T>
 struct Serializer<T, std::enable_if_t<std::is_convertible_v<T, fmt::string_view>>>
 {
-  using serialized_type = std::string;
+  using serialized_type = std::string_view;
+
+  static constexpr std::size_t encoded_size(const fmt::string_view val) { return sizeof(std::size_t) + val.size(); }
 
-  static bool to_bytes(ByteBuffer::Writer& writer, const fmt::string_view val)
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const fmt::string_view val)
   {
     bool good = write_to_buffer(writer, val.size());
     good = good && writer.write(std::as_bytes(std::span(val.begin(), val.end())));
     return good;
   };
 
-  static bool from_bytes(ByteBuffer::Reader& reader, serialized_type& val)
+  template<ViewableByteReader Reader>
+  static bool from_bytes(Reader& reader, serialized_type& val)
   {
     std::size_t sz;
     if (!read_from_buffer<decltype(sz)>(reader, sz))
       return false;
 
-    val.resize(sz);
-    return reader.read(std::as_writable_bytes(std::span(val.begin(), val.end())));
+    std::span<const std::byte> bytes;
+    if (!reader.read_view(sz, bytes))
+      return false;
+
+    val = std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return true;
+  }
+};
+
+// Empty alternatives of variants take up no space at all.
+template<>
+struct Serializer<std::monostate>
+{
+  using serialized_type = std::monostate;
+
+  static constexpr std::size_t fixed_size = 0;
+
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer&, std::monostate)
+  {
+    return true;
+  }
+
+  template<ByteReader Reader>
+  static bool from_bytes(Reader&, std::monostate&)
+  {
+    return true;
   }
 };
 
-} // namespace hage
\ No newline at end of file
+template<typename Rep, typename Period>
+struct Serializer<std::chrono::duration<Rep, Period>> : details::BytesSerializer<std::chrono::duration<Rep, Period>>
+{};
+
+// fmt can only format the time points of some clocks, the others are read back as the time since their epoch.
+template<typename Clock, typename Duration>
+struct Serializer<std::chrono::time_point<Clock, Duration>>
+{
+  using time_point = std::chrono::time_point<Clock, Duration>;
+  using serialized_type = std::conditional_t<fmt::is_formattable<time_point>::value, time_point, Duration>;
+
+  static constexpr std::size_t fixed_size = sizeof(serialized_type);
+
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const time_point& val)
+  {
+    if constexpr (std::is_same_v<serialized_type, time_point>) {
+      return writer.write(details::singular_bytes(val));
+    } else {
+      const auto sinceEpoch = val.time_since_epoch();
+      return writer.write(details::singular_bytes(sinceEpoch));
+    }
+  }
+
+  template<ByteReader Reader>
+  static bool from_bytes(Reader& reader, serialized_type& val)
+  {
+    return reader.read(details::singular_writable_bytes(val));
+  }
+};
+
+/**
+ * A view of values that were copied into a buffer as bytes, so they might not be aligned for T. Each value is copied
+ * out as it is read. It is what contiguous ranges are read back as, which lets the consumer format them straight from
+ * the buffer.
+ */
+template<typename T>
+class UnalignedSpan
+{
+public:
+  class iterator
+  {
+  public:
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(const std::byte* pos) : m_pos{ pos } {}
+
+    T operator*() const
+    {
+      T value;
+      std::memcpy(&value, m_pos, sizeof(T));
+      return value;
+    }
+
+    iterator& operator++()
+    {
+      m_pos += sizeof(T);
+      return *this;
+    }
+
+    iterator operator++(int)
+    {
+      auto old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const iterator&) const = default;
+
+  private:
+    const std::byte* m_pos{ nullptr };
+  };
+
+  UnalignedSpan() = default;
+  explicit UnalignedSpan(const std::span<const std::byte> bytes) : m_bytes{ bytes } {}
+
+  [[nodiscard]] iterator begin() const { return iterator(m_bytes.data()); }
+  [[nodiscard]] iterator end() const { return iterator(m_bytes.data() + m_bytes.size()); }
+
+  [[nodiscard]] std::size_t size() const { return m_bytes.size() / sizeof(T); }
+  [[nodiscard]] bool empty() const { return m_bytes.empty(); }
+
+  T operator[](const std::size_t i) const { return *iterator(m_bytes.data() + i * sizeof(T)); }
+
+private:
+  std::span<const std::byte> m_bytes;
+};
+
+// Arrays have their size in their type, so they are copied without one.
+template<typename T, std::size_t N>
+struct Serializer<std::array<T, N>, std::enable_if_t<BitwiseSerializable<T>>>
+  : details::BytesSerializer<std::array<T, N>>
+{};
+
+// Other contiguous ranges are copied with their size in front of them.
+template<typename T>
+struct Serializer<T,
+                  std::enable_if_t<std::ranges::contiguous_range<const T> && std::ranges::sized_range<const T> &&
+                                   BitwiseSerializable<std::ranges::range_value_t<T>> &&
+                                   !details::is_std_array<T>::value && !std::is_convertible_v<T, fmt::string_view>>>
+{
+  using element_type = std::ranges::range_value_t<T>;
+  using serialized_type = UnalignedSpan<element_type>;
+
+  static constexpr std::size_t encoded_size(const T& val)
+  {
+    return sizeof(std::size_t) + std::ranges::size(val) * sizeof(element_type);
+  }
+
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const T& val)
+  {
+    const std::span<const element_type> elements(std::ranges::data(val), std::ranges::size(val));
+    bool good = write_to_buffer(writer, elements.size());
+    good = good && writer.write(std::as_bytes(elements));
+    return good;
+  }
+
+  template<ViewableByteReader Reader>
+  static bool from_bytes(Reader& reader, serialized_type& val)
+  {
+    std::size_t count;
+    if (!read_from_buffer<decltype(count)>(reader, count))
+      return false;
+
+    std::span<const std::byte> bytes;
+    if (!reader.read_view(count * sizeof(element_type), bytes))
+      return false;
+
+    val = serialized_type(bytes);
+    return true;
+  }
+};
+
+template<typename T>
+struct Serializer<std::optional<T>>
+{
+  using serialized_type = std::optional<typename SmartSerializer<T>::serialized_type>;
+
+  static constexpr std::size_t encoded_size(const std::optional<T>& val)
+    requires SizedSerializer<T>
+  {
+    return sizeof(bool) + (val ? hage::encoded_size<T>(*val) : 0);
+  }
+
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const std::optional<T>& val)
+  {
+    bool good = write_to_buffer(writer, val.has_value());
+    good = good && (!val || write_to_buffer(writer, *val));
+    return good;
+  }
+
+  template<ByteReader Reader>
+  static bool from_bytes(Reader& reader, serialized_type& val)
+  {
+    bool hasValue;
+    if (!read_from_buffer<bool>(reader, hasValue))
+      return false;
+
+    if (!hasValue) {
+      val.reset();
+      return true;
+    }
+    return read_from_buffer<T>(reader, val.emplace());
+  }
+};
+
+// The index of the alternative is written first, as a single byte.
+template<typename... Ts>
+struct Serializer<std::variant<Ts...>>
+{
+  static_assert(sizeof...(Ts) <= std::numeric_limits<std::uint8_t>::max());
+
+  using serialized_type = std::variant<typename SmartSerializer<Ts>::serialized_type...>;
+
+  static constexpr std::size_t encoded_size(const std::variant<Ts...>& val)
+    requires(... && SizedSerializer<Ts>)
+  {
+    const auto alternativeSize = [](const auto& alternative) { return hage::encoded_size(alternative); };
+    return sizeof(std::uint8_t) + std::visit(alternativeSize, val);
+  }
+
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const std::variant<Ts...>& val)
+  {
+    bool good = write_to_buffer(writer, static_cast<std::uint8_t>(val.index()));
+    good = good && std::visit([&writer](const auto& alternative) { return write_to_buffer(writer, alternative); }, val);
+    return good;
+  }
+
+  template<ByteReader Reader>
+  static bool from_bytes(Reader& reader, serialized_type& val)
+  {
+    std::uint8_t index;
+    if (!read_from_buffer<decltype(index)>(reader, index))
+      return false;
+
+    return [&reader, &val, index]<std::size_t... Is>(std::index_sequence<Is...>) {
+      return (... || (Is == index && read_from_buffer<Ts>(reader, val.template emplace<Is>())));
+    }(std::index_sequence_for<Ts...>{});
+  }
+};
+
+namespace details {
+// Pairs and tuples are written element by element, and read back as the same kind of tuple of the serialized types.
+template<template<typename...> typename Tuple, typename... Ts>
+struct TupleSerializer
+{
+  using value_type = Tuple<Ts...>;
+  using serialized_type = Tuple<typename SmartSerializer<Ts>::serialized_type...>;
+
+  static constexpr std::size_t encoded_size(const value_type& val)
+    requires(... && SizedSerializer<Ts>)
+  {
+    return [&val]<std::size_t... Is>(std::index_sequence<Is...>) {
+      return (std::size_t{ 0 } + ... + hage::encoded_size<Ts>(std::get<Is>(val)));
+    }(std::index_sequence_for<Ts...>{});
+  }
+
+  template<ByteWriter Writer>
+  static bool to_bytes(Writer& writer, const value_type& val)
+  {
+    return std::apply([&writer](const auto&... elements) { return (true && ... && write_to_buffer(writer, elements)); },
+                      val);
+  }
+
+  template<ByteReader Reader>
+  static bool from_bytes(Reader& reader, serialized_type& val)
+  {
+    return [&reader, &val]<std::size_t... Is>(std::index_sequence<Is...>) {
+      return (true && ... && read_from_buffer<Ts>(reader, std::get<Is>(val)));
+    }(std::index_sequence_for<Ts...>{});
+  }
+};
+} // namespace details
+
+template<typename First, typename Second>
+struct Serializer<std::pair<First, Second>> : details::TupleSerializer<std::pair, First, Second>
+{};
+
+template<typename... Ts>
+struct Serializer<std::tuple<Ts...>> : details::TupleSerializer<std::tuple, Ts...>
+{};
+
+/**
+ * Describes how an argument was serialized, for readers that don't have the type, such as the binary log decoder. Only
+ * the types that can be formatted without knowing anything else about them are described, the rest are Unsupported.
+ */
+enum class ArgumentType : std::uint8_t
+{
+  Unsupported = 0,
+  Bool,
+  Char,
+  Int8,
+  UInt8,
+  Int16,
+  UInt16,
+  Int32,
+  UInt32,
+  Int64,
+  UInt64,
+  Float,
+  Double,
+  LongDouble,
+  String,
+  Pointer
+};
+
+template<typename T>
+constexpr ArgumentType
+argument_type_of()
+{
+  using U = typename SmartSerializer<T>::serialized_type;
+  if constexpr (std::is_same_v<U, bool>)
+    return ArgumentType::Bool;
+  else if constexpr (std::is_same_v<U, char>)
+    return ArgumentType::Char;
+  else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+    switch (sizeof(U)) {
+      case 1:
+        return ArgumentType::Int8;
+      case 2:
+        return ArgumentType::Int16;
+      case 4:
+        return ArgumentType::Int32;
+      case 8:
+        return ArgumentType::Int64;
+      default:
+        return ArgumentType::Unsupported;
+    }
+  } else if constexpr (std::is_integral_v<U> && std::is_unsigned_v<U>) {
+    switch (sizeof(U)) {
+      case 1:
+        return ArgumentType::UInt8;
+      case 2:
+        return ArgumentType::UInt16;
+      case 4:
+        return ArgumentType::UInt32;
+      case 8:
+        return ArgumentType::UInt64;
+      default:
+        return ArgumentType::Unsupported;
+    }
+  } else if constexpr (std::is_same_v<U, float>)
+    return ArgumentType::Float;
+  else if constexpr (std::is_same_v<U, double>)
+    return ArgumentType::Double;
+  else if constexpr (std::is_same_v<U, long double>)
+    return ArgumentType::LongDouble;
+  else if constexpr (std::is_same_v<U, std::string_view>)
+    return ArgumentType::String;
+  else if constexpr (std::is_same_v<U, const void*> || std::is_same_v<U, void*>)
+    return ArgumentType::Pointer;
+  else
+    return ArgumentType::Unsupported;
+}
+
+} // namespace hage
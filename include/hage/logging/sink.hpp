@@ -2,7 +2,12 @@
 
 #include <hage/core/concepts.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <source_location>
+#include <span>
+#include <string_view>
 #include <vector>
 
 namespace hage {
@@ -16,14 +21,80 @@ enum class LogLevel : std::int8_t
   Critical = 5
 };
 
+/**
+ * Where a log statement is in the source. It has the same accessors as std::source_location, which it is made from, but
+ * can also be filled in from elsewhere, such as the sites stored in a binary log.
+ */
+class SourceLocation
+{
+public:
+  constexpr SourceLocation() = default;
+
+  constexpr SourceLocation(const std::string_view file,
+                           const std::string_view function,
+                           const std::uint32_t line,
+                           const std::uint32_t column)
+    : m_file{ file }
+    , m_function{ function }
+    , m_line{ line }
+    , m_column{ column }
+  {
+  }
+
+  // Implicit, so the location of a log site can be passed as it is.
+  constexpr SourceLocation(const std::source_location& location)
+    : SourceLocation(location.file_name(), location.function_name(), location.line(), location.column())
+  {
+  }
+
+  [[nodiscard]] constexpr std::string_view file_name() const { return m_file; }
+  [[nodiscard]] constexpr std::string_view function_name() const { return m_function; }
+  [[nodiscard]] constexpr std::uint32_t line() const { return m_line; }
+  [[nodiscard]] constexpr std::uint32_t column() const { return m_column; }
+
+private:
+  std::string_view m_file;
+  std::string_view m_function;
+  std::uint32_t m_line{ 0 };
+  std::uint32_t m_column{ 0 };
+};
+
 class Sink
 {
 public:
   using timestamp_type = std::chrono::time_point<std::chrono::system_clock>;
 
+  struct Record
+  {
+    LogLevel level;
+    timestamp_type ts;
+    std::string_view line;
+    // Only known for lines logged through the HAGE_LOG macros, and for lines decoded from a binary log. Like the line,
+    // the names are only valid during the call.
+    SourceLocation location;
+    // The thread the line was logged from, as numbered by this_thread_log_id. Zero when it isn't known.
+    std::uint32_t thread{ 0 };
+  };
+
   virtual ~Sink() = default;
   virtual void receive(LogLevel level, const timestamp_type& ts, std::string_view line) = 0;
 
+  /**
+   * Receives all the lines a logger read in one go. The lines are only valid during the call. Sinks that can write many
+   * lines at once should override this, the default just calls receive for each of them.
+   */
+  virtual void receive_batch(const std::span<const Record> records)
+  {
+    for (const auto& record : records)
+      receive(record.level, record.ts, record.line);
+  }
+
+  /**
+   * Called by the consumer when it has nothing to read, with the current time. Sinks that hold on to lines, such as
+   * FileSink, write out the ones that have waited longer than they allow. The default does nothing.
+   */
+  virtual void on_idle(const timestamp_type&) {}
+
   // disable assignment operator (due to the problem of slicing):
   Sink& operator=(Sink&&) = delete;
   Sink& operator=(const Sink&) = delete;
@@ -42,6 +113,7 @@ class NullSink final : public Sink
 {
 public:
   void receive(LogLevel, const timestamp_type&, std::string_view) override {}
+  void receive_batch(std::span<const Record>) override {}
 };
 
 /**
@@ -58,6 +130,22 @@ public:
       m_nextSink->receive(level, ts, line);
   }
 
+  // Passes on each run of lines that make it through, so it is a single call when they all do.
+  void receive_batch(const std::span<const Record> records) override
+  {
+    auto it = records.begin();
+    while (it != records.end()) {
+      const auto first = std::find_if(it, records.end(), [this](const Record& r) { return m_minLevel <= r.level; });
+      const auto last = std::find_if(first, records.end(), [this](const Record& r) { return r.level < m_minLevel; });
+      if (first != last)
+        m_nextSink->receive_batch(std::span(first, last));
+
+      it = last;
+    }
+  }
+
+  void on_idle(const timestamp_type& now) override { m_nextSink->on_idle(now); }
+
 private:
   Sink* m_nextSink{ nullptr };
   LogLevel m_minLevel;
@@ -83,6 +171,20 @@ public:
     }
   }
 
+  void receive_batch(const std::span<const Record> records) override
+  {
+    for (const auto& sink : m_sinks) {
+      sink->receive_batch(records);
+    }
+  }
+
+  void on_idle(const timestamp_type& now) override
+  {
+    for (const auto& sink : m_sinks) {
+      sink->on_idle(now);
+    }
+  }
+
 private:
   std::vector<Sink*> m_sinks;
 };
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "sink.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+#include <fmt/format.h>
+
+namespace hage {
+
+/**
+ * How many digits of the second are written, after the decimal point.
+ */
+enum class TimestampPrecision : std::uint8_t
+{
+  Seconds = 0,
+  Milliseconds = 3,
+  Microseconds = 6,
+  Nanoseconds = 9
+};
+
+// The precision of the timestamps the sinks are given, which is what the sinks used to print.
+inline constexpr TimestampPrecision native_timestamp_precision = []() {
+  std::uint8_t digits = 0;
+  for (auto den = Sink::timestamp_type::period::den; 1 < den && digits < 9; den /= 10)
+    digits++;
+  return static_cast<TimestampPrecision>(digits);
+}();
+
+/**
+ * Writes timestamps as "2024-04-05 10:00:00.123456789 +0000", in UTC. The date and time are only formatted when the
+ * second changes, and the digits after it are written by hand, so this costs little more than a copy for most lines.
+ */
+class TimestampCache
+{
+public:
+  explicit TimestampCache(const TimestampPrecision precision = native_timestamp_precision) : m_precision{ precision } {}
+
+  void set_precision(const TimestampPrecision precision) { m_precision = precision; }
+  [[nodiscard]] TimestampPrecision precision() const { return m_precision; }
+
+  void append(fmt::memory_buffer& out, const Sink::timestamp_type& ts)
+  {
+    const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(ts.time_since_epoch()).count();
+    auto seconds = nanos / 1'000'000'000;
+    auto subsecond = nanos % 1'000'000'000;
+    if (subsecond < 0) {
+      subsecond += 1'000'000'000;
+      seconds--;
+    }
+
+    if (seconds != m_second)
+      render(seconds);
+
+    out.append(m_prefix.data(), m_prefix.data() + m_prefixSize);
+
+    if (const auto digits = static_cast<int>(m_precision); 0 < digits) {
+      constexpr std::array<std::int64_t, 10> powers{ 1, 10, 100, 1'000, 10'000, 100'000, 1'000'000, 10'000'000,
+                                                     100'000'000, 1'000'000'000 };
+      std::array<char, 10> fraction{ '.' };
+      auto value = subsecond / powers[9 - digits];
+      for (int i = digits; 0 < i; i--) {
+        fraction[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+      }
+      out.append(fraction.data(), fraction.data() + digits + 1);
+    }
+
+    constexpr std::string_view zone = " +0000";
+    out.append(zone.data(), zone.data() + zone.size());
+  }
+
+private:
+  void render(const std::int64_t seconds)
+  {
+    const std::chrono::sys_seconds time{ std::chrono::seconds(seconds) };
+    const auto day = std::chrono::floor<std::chrono::days>(time);
+    const std::chrono::year_month_day date{ day };
+    const std::chrono::hh_mm_ss clock{ time - day };
+
+    const auto result = fmt::format_to_n(m_prefix.data(),
+                                         m_prefix.size(),
+                                         "{:04}-{:02}-{:02} {:02}:{:02}:{:02}",
+                                         static_cast<int>(date.year()),
+                                         static_cast<unsigned>(date.month()),
+                                         static_cast<unsigned>(date.day()),
+                                         clock.hours().count(),
+                                         clock.minutes().count(),
+                                         clock.seconds().count());
+    m_prefixSize = std::min(result.size, m_prefix.size());
+    m_second = seconds;
+  }
+
+  TimestampPrecision m_precision;
+  std::int64_t m_second{ std::numeric_limits<std::int64_t>::min() };
+  std::array<char, 32> m_prefix{};
+  std::size_t m_prefixSize{ 0 };
+};
+
+} // namespace hage
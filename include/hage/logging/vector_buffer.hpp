@@ -28,6 +28,7 @@ class VectorBuffer final : public ByteBuffer
 
   index_type m_writeLevel{ 0 };
 
+public:
   class Reader final : public ByteBuffer::Reader
   {
   public:
@@ -43,6 +44,9 @@ class VectorBuffer final : public ByteBuffer
 #endif
     }
 
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
 #if HAGE_DEBUG
     ~Reader() override
     {
@@ -100,6 +104,9 @@ class VectorBuffer final : public ByteBuffer
 #endif
     }
 
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
     ~Writer() override
     {
       std::scoped_lock lk(m_parent.m_mtx);
@@ -136,10 +143,12 @@ class VectorBuffer final : public ByteBuffer
     std::size_t m_bytesWritten{ 0 };
   };
 
-public:
   [[nodiscard]] std::unique_ptr<ByteBuffer::Reader> get_reader() override { return std::make_unique<Reader>(*this); }
   [[nodiscard]] std::unique_ptr<ByteBuffer::Writer> get_writer() override { return std::make_unique<Writer>(*this); }
 
+  [[nodiscard]] Reader reader() { return Reader(*this); }
+  [[nodiscard]] Writer writer() { return Writer(*this); }
+
   [[nodiscard]] constexpr std::size_t capacity() override { return std::numeric_limits<std::size_t>::max(); }
 };
 
@@ -0,0 +1,501 @@
+#include <hage/logging/async_file_sink.hpp>
+
+#include <fmt/os.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAGE_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace hage;
+
+class AsyncFileSink::Backend
+{
+public:
+  virtual ~Backend() = default;
+
+  [[nodiscard]] virtual bool io_uring() const = 0;
+
+  // Writes all of data at the offset. The buffer index is reported by reap once it is done.
+  virtual void submit(std::size_t index, std::span<const char> data, std::uint64_t offset) = 0;
+
+  // Adds the indices of the finished writes to done, waiting for at least one if wait is set. Throws if a write failed,
+  // but only after the failed write, and every other one it found done, have been added.
+  virtual void reap(bool wait, std::vector<std::size_t>& done) = 0;
+};
+
+namespace {
+
+void
+write_all(const int fd, std::span<const char> data, std::uint64_t offset)
+{
+  while (!data.empty()) {
+#if defined(_WIN32)
+    // There is no pwrite on windows, but only this thread writes to the file, so seeking first does the same.
+    if (::_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0)
+      throw std::system_error(errno, std::generic_category(), "lseek");
+    const auto written = ::_write(fd, data.data(), static_cast<unsigned int>(data.size()));
+#else
+    const auto written = ::pwrite(fd, data.data(), data.size(), static_cast<off_t>(offset));
+#endif
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::system_error(errno, std::generic_category(), "pwrite");
+    }
+
+    data = data.subspan(static_cast<std::size_t>(written));
+    offset += static_cast<std::uint64_t>(written);
+  }
+}
+
+// Does the writes on a helper thread, one at a time.
+class ThreadBackend final : public AsyncFileSink::Backend
+{
+public:
+  explicit ThreadBackend(const int fd) : m_fd{ fd }, m_thread([this](const std::stop_token& stop) { run(stop); }) {}
+
+  [[nodiscard]] bool io_uring() const override { return false; }
+
+  void submit(const std::size_t index, const std::span<const char> data, const std::uint64_t offset) override
+  {
+    {
+      std::scoped_lock lock(m_mutex);
+      m_jobs.push_back(Job{ index, data, offset });
+    }
+    m_submitted.notify_one();
+  }
+
+  void reap(const bool wait, std::vector<std::size_t>& done) override
+  {
+    std::unique_lock lock(m_mutex);
+    if (wait)
+      m_completed.wait(lock, [this]() { return !m_done.empty() || m_error; });
+
+    done.insert(done.end(), m_done.begin(), m_done.end());
+    m_done.clear();
+
+    if (m_error)
+      std::rethrow_exception(std::exchange(m_error, nullptr));
+  }
+
+private:
+  struct Job
+  {
+    std::size_t index;
+    std::span<const char> data;
+    std::uint64_t offset;
+  };
+
+  void run(const std::stop_token& stop)
+  {
+    while (true) {
+      Job job{};
+      {
+        std::unique_lock lock(m_mutex);
+        if (!m_submitted.wait(lock, stop, [this]() { return !m_jobs.empty(); }))
+          return;
+
+        job = m_jobs.front();
+        m_jobs.pop_front();
+      }
+
+      std::exception_ptr error;
+      try {
+        write_all(m_fd, job.data, job.offset);
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      {
+        std::scoped_lock lock(m_mutex);
+        m_done.push_back(job.index);
+        if (error)
+          m_error = error;
+      }
+      m_completed.notify_one();
+    }
+  }
+
+  int m_fd;
+
+  std::mutex m_mutex;
+  std::condition_variable_any m_submitted;
+  std::condition_variable m_completed;
+  std::deque<Job> m_jobs;
+  std::vector<std::size_t> m_done;
+  std::exception_ptr m_error;
+
+  // Last, so it is stopped before the rest is destroyed.
+  std::jthread m_thread;
+};
+
+#if HAGE_HAS_IO_URING
+// Submits the writes through an io_uring, with the raw syscalls, so the consumer never enters a blocking write.
+class IoUringBackend final : public AsyncFileSink::Backend
+{
+public:
+  // Returns null if io_uring isn't available, or the kernel is too old to have IORING_OP_WRITE.
+  static std::unique_ptr<IoUringBackend> create(const int fd, const unsigned entries)
+  {
+    io_uring_params params{};
+    const auto ring = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring < 0)
+      return nullptr;
+
+    // IORING_OP_WRITE came in the same kernel as this feature.
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+      ::close(ring);
+      return nullptr;
+    }
+
+    auto backend = std::unique_ptr<IoUringBackend>(new IoUringBackend(fd, ring, entries));
+    if (!backend->map(params))
+      return nullptr;
+
+    return backend;
+  }
+
+  ~IoUringBackend() override
+  {
+    if (m_sqes != MAP_FAILED)
+      ::munmap(m_sqes, m_sqesSize);
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+      ::munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing != MAP_FAILED)
+      ::munmap(m_sqRing, m_sqRingSize);
+    ::close(m_ring);
+  }
+
+  [[nodiscard]] bool io_uring() const override { return true; }
+
+  void submit(const std::size_t index, const std::span<const char> data, const std::uint64_t offset) override
+  {
+    m_pending[index] = Pending{ data, offset };
+    push(index);
+    enter(1, 0);
+  }
+
+  void reap(const bool wait, std::vector<std::size_t>& done) override
+  {
+    if (wait)
+      enter(0, 1);
+
+    // A failed write still hands its buffer back, and the rest of the batch is reaped before we throw.
+    int error = 0;
+    unsigned resubmitted = 0;
+    unsigned head = *m_cqHead;
+    const unsigned tail = std::atomic_ref(*m_cqTail).load(std::memory_order::acquire);
+    for (; head != tail; head++) {
+      const auto& cqe = m_cqes[head & *m_cqMask];
+      const auto index = static_cast<std::size_t>(cqe.user_data);
+      if (cqe.res < 0) {
+        error = error ? error : -cqe.res;
+        done.push_back(index);
+        continue;
+      }
+
+      // Short writes are resubmitted with what is left.
+      auto& pending = m_pending[index];
+      const auto written = static_cast<std::size_t>(cqe.res);
+      if (written < pending.data.size()) {
+        pending.data = pending.data.subspan(written);
+        pending.offset += written;
+        push(index);
+        resubmitted++;
+      } else {
+        done.push_back(index);
+      }
+    }
+    std::atomic_ref(*m_cqHead).store(head, std::memory_order::release);
+
+    if (resubmitted)
+      enter(resubmitted, 0);
+    if (error)
+      throw std::system_error(error, std::generic_category(), "io_uring write");
+  }
+
+private:
+  struct Pending
+  {
+    std::span<const char> data;
+    std::uint64_t offset;
+  };
+
+  IoUringBackend(const int fd, const int ring, const unsigned entries) : m_fd{ fd }, m_ring{ ring }, m_pending(entries)
+  {
+  }
+
+  bool map(const io_uring_params& params)
+  {
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap)
+      m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+    constexpr int prot = PROT_READ | PROT_WRITE;
+    constexpr int flags = MAP_SHARED | MAP_POPULATE;
+    m_sqRing = ::mmap(nullptr, m_sqRingSize, prot, flags, m_ring, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED)
+      return false;
+
+    m_cqRing = singleMap ? m_sqRing : ::mmap(nullptr, m_cqRingSize, prot, flags, m_ring, IORING_OFF_CQ_RING);
+    if (m_cqRing == MAP_FAILED)
+      return false;
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = ::mmap(nullptr, m_sqesSize, prot, flags, m_ring, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+      return false;
+
+    const auto sq = static_cast<char*>(m_sqRing);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    const auto cq = static_cast<char*>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  // There is never more than one write per buffer in flight, and the ring has an entry for each, so this can't overflow.
+  void push(const std::size_t index)
+  {
+    const auto& pending = m_pending[index];
+    const unsigned tail = *m_sqTail;
+    const unsigned slot = tail & *m_sqMask;
+
+    auto& sqe = static_cast<io_uring_sqe*>(m_sqes)[slot];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITE;
+    sqe.fd = m_fd;
+    sqe.addr = reinterpret_cast<std::uint64_t>(pending.data.data());
+    sqe.len = static_cast<std::uint32_t>(pending.data.size());
+    sqe.off = pending.offset;
+    sqe.user_data = index;
+
+    m_sqArray[slot] = slot;
+    std::atomic_ref(*m_sqTail).store(tail + 1, std::memory_order::release);
+  }
+
+  void enter(const unsigned toSubmit, const unsigned minComplete)
+  {
+    const unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    while (::syscall(__NR_io_uring_enter, m_ring, toSubmit, minComplete, flags, nullptr, 0) < 0) {
+      if (errno != EINTR)
+        throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+    }
+  }
+
+  int m_fd;
+  int m_ring;
+  std::vector<Pending> m_pending;
+
+  void* m_sqRing{ MAP_FAILED };
+  void* m_cqRing{ MAP_FAILED };
+  void* m_sqes{ MAP_FAILED };
+  std::size_t m_sqRingSize{ 0 };
+  std::size_t m_cqRingSize{ 0 };
+  std::size_t m_sqesSize{ 0 };
+
+  unsigned* m_sqTail{};
+  unsigned* m_sqMask{};
+  unsigned* m_sqArray{};
+  unsigned* m_cqHead{};
+  unsigned* m_cqTail{};
+  unsigned* m_cqMask{};
+  io_uring_cqe* m_cqes{};
+};
+#endif
+} // namespace
+
+AsyncFileSink::AsyncFileSink(const std::filesystem::path& path, const Config config, const int flags)
+  : m_config{ config }
+  , m_file(path.string(), flags)
+{
+  if (m_config.bufferCount == 0)
+    throw std::runtime_error("The sink needs at least one buffer");
+
+  // Without truncation, we write after what is already there.
+  m_offset = std::filesystem::file_size(path);
+
+  m_buffers.resize(m_config.bufferCount);
+  m_submitted.resize(m_config.bufferCount);
+  for (std::size_t i = 0; i < m_config.bufferCount; i++) {
+    m_buffers[i].reserve(m_config.policy.bufferSize);
+    if (i != 0)
+      m_free.push_back(i);
+  }
+  m_current = 0;
+
+#if HAGE_HAS_IO_URING
+  if (m_config.useIoUring)
+    m_backend = IoUringBackend::create(m_file.descriptor(), static_cast<unsigned>(m_config.bufferCount));
+#endif
+  if (!m_backend)
+    m_backend = std::make_unique<ThreadBackend>(m_file.descriptor());
+}
+
+AsyncFileSink::~AsyncFileSink()
+{
+  try {
+    flush();
+  } catch (...) {
+    fmt::print(stderr, "Unable to flush async file sink\n");
+  }
+}
+
+void
+AsyncFileSink::receive(const LogLevel level, const timestamp_type& ts, const std::string_view line)
+{
+  const Record record{ level, ts, line, {} };
+  receive_batch(std::span(&record, 1));
+}
+
+void
+AsyncFileSink::receive_batch(const std::span<const Record> records)
+{
+  if (records.empty())
+    return;
+
+  auto& buffer = m_buffers[m_current];
+  if (buffer.size() == 0)
+    m_oldestBuffered = records.front().ts;
+
+  const auto before = buffer.size();
+  bool urgent = false;
+  for (const auto& record : records) {
+    m_pattern.format(buffer, record);
+    urgent = urgent || m_config.policy.flushLevel <= record.level;
+  }
+  m_bytesWritten += buffer.size() - before;
+
+  const auto& policy = m_config.policy;
+  if (urgent || policy.bufferSize <= buffer.size() || policy.maxDelay <= records.back().ts - m_oldestBuffered)
+    submit_current();
+}
+
+void
+AsyncFileSink::on_idle(const timestamp_type& now)
+{
+  if (m_buffers[m_current].size() != 0 && m_config.policy.maxDelay <= now - m_oldestBuffered)
+    submit_current();
+}
+
+void
+AsyncFileSink::flush()
+{
+  submit_current();
+  while (0 < m_inFlight.load(std::memory_order::relaxed))
+    reap(true);
+}
+
+AsyncFileSink::Stats
+AsyncFileSink::stats() const
+{
+  return Stats{ m_inFlight.load(std::memory_order::relaxed),
+                m_writesCompleted.load(std::memory_order::relaxed),
+                std::chrono::nanoseconds(m_totalLatency.load(std::memory_order::relaxed)),
+                std::chrono::nanoseconds(m_maxLatency.load(std::memory_order::relaxed)) };
+}
+
+bool
+AsyncFileSink::uses_io_uring() const
+{
+  return m_backend->io_uring();
+}
+
+void
+AsyncFileSink::submit_current()
+{
+  const auto& buffer = m_buffers[m_current];
+  if (buffer.size() == 0)
+    return;
+
+  m_submitted[m_current] = std::chrono::steady_clock::now();
+  m_backend->submit(m_current, std::span<const char>(buffer.data(), buffer.size()), m_offset);
+  m_offset += buffer.size();
+  m_inFlight.fetch_add(1, std::memory_order::relaxed);
+
+  // This is the only place we wait for the disk, when every buffer is still being written. A failed write is only
+  // passed on once we have moved off the buffer we just submitted, so it isn't filled while it is being written. If
+  // nothing came back with the failure, the backend itself is broken, and waiting longer won't help.
+  std::exception_ptr error;
+  const auto reapKeepingError = [this, &error](const bool wait) {
+    try {
+      reap(wait);
+    } catch (...) {
+      if (m_completed.empty())
+        throw;
+      error = error ? error : std::current_exception();
+    }
+  };
+
+  reapKeepingError(false);
+  while (m_free.empty())
+    reapKeepingError(true);
+
+  m_current = m_free.back();
+  m_free.pop_back();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void
+AsyncFileSink::reap(const bool wait)
+{
+  m_completed.clear();
+
+  // The buffers of the writes that did finish are given back before a failure is passed on, or we would wait for them
+  // forever.
+  std::exception_ptr error;
+  try {
+    m_backend->reap(wait, m_completed);
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  // The latency is until we see the write is done, which is as soon as we look.
+  const auto now = std::chrono::steady_clock::now();
+  for (const auto index : m_completed) {
+    const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_submitted[index]).count();
+    m_totalLatency.fetch_add(latency, std::memory_order::relaxed);
+    if (m_maxLatency.load(std::memory_order::relaxed) < latency)
+      m_maxLatency.store(latency, std::memory_order::relaxed);
+
+    m_writesCompleted.fetch_add(1, std::memory_order::relaxed);
+    m_inFlight.fetch_sub(1, std::memory_order::relaxed);
+
+    m_buffers[index].clear();
+    m_free.push_back(index);
+  }
+
+  if (error)
+    std::rethrow_exception(error);
+}
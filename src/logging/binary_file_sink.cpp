@@ -0,0 +1,307 @@
+#include <hage/logging/binary_file_sink.hpp>
+
+#include <hage/logging/logger.hpp>
+
+#include <fmt/args.h>
+#include <fmt/format.h>
+
+#include <array>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace hage;
+
+namespace {
+// The buffer is written out when it gets this large.
+constexpr std::size_t s_flushSize = 64 * 1024;
+
+// The lines that had to be formatted by the logger are stored as the single argument of one of these.
+constexpr std::array<ArgumentType, 1> s_lineArguments{ ArgumentType::String };
+constexpr std::array<LogSiteInfo, 6> s_lineSites{ {
+  { LogLevel::Trace, "{}", {}, s_lineArguments },
+  { LogLevel::Debug, "{}", {}, s_lineArguments },
+  { LogLevel::Info, "{}", {}, s_lineArguments },
+  { LogLevel::Warn, "{}", {}, s_lineArguments },
+  { LogLevel::Error, "{}", {}, s_lineArguments },
+  { LogLevel::Critical, "{}", {}, s_lineArguments },
+} };
+
+enum class EntryType : char
+{
+  Site = 'D',
+  Record = 'R'
+};
+
+std::int64_t
+to_nanos(const Sink::timestamp_type& ts)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(ts.time_since_epoch()).count();
+}
+
+Sink::timestamp_type
+from_nanos(const std::int64_t nanos)
+{
+  using duration = Sink::timestamp_type::duration;
+  return Sink::timestamp_type(std::chrono::duration_cast<duration>(std::chrono::nanoseconds(nanos)));
+}
+
+struct DecodedSite
+{
+  LogLevel level;
+  SourceLocation location;
+  std::string_view format;
+  std::vector<ArgumentType> arguments;
+};
+
+template<typename T>
+bool
+push_argument(SpanReader& reader, fmt::dynamic_format_arg_store<fmt::format_context>& store)
+{
+  typename SmartSerializer<T>::serialized_type value;
+  if (!read_from_buffer<T>(reader, value))
+    return false;
+
+  store.push_back(value);
+  return true;
+}
+
+bool
+push_argument(const ArgumentType type, SpanReader& reader, fmt::dynamic_format_arg_store<fmt::format_context>& store)
+{
+  switch (type) {
+    case ArgumentType::Bool:
+      return push_argument<bool>(reader, store);
+    case ArgumentType::Char:
+      return push_argument<char>(reader, store);
+    case ArgumentType::Int8:
+      return push_argument<std::int8_t>(reader, store);
+    case ArgumentType::UInt8:
+      return push_argument<std::uint8_t>(reader, store);
+    case ArgumentType::Int16:
+      return push_argument<std::int16_t>(reader, store);
+    case ArgumentType::UInt16:
+      return push_argument<std::uint16_t>(reader, store);
+    case ArgumentType::Int32:
+      return push_argument<std::int32_t>(reader, store);
+    case ArgumentType::UInt32:
+      return push_argument<std::uint32_t>(reader, store);
+    case ArgumentType::Int64:
+      return push_argument<std::int64_t>(reader, store);
+    case ArgumentType::UInt64:
+      return push_argument<std::uint64_t>(reader, store);
+    case ArgumentType::Float:
+      return push_argument<float>(reader, store);
+    case ArgumentType::Double:
+      return push_argument<double>(reader, store);
+    case ArgumentType::LongDouble:
+      return push_argument<long double>(reader, store);
+    case ArgumentType::String:
+      return push_argument<std::string_view>(reader, store);
+    case ArgumentType::Pointer:
+      return push_argument<const void*>(reader, store);
+    case ArgumentType::Unsupported:
+      break;
+  }
+  return false;
+}
+
+// Enums fmt can't format are read back as their underlying type.
+template<typename E>
+bool
+read_enum(SpanReader& reader, E& value)
+{
+  std::underlying_type_t<E> underlying;
+  if (!read_from_buffer<E>(reader, underlying))
+    return false;
+
+  value = static_cast<E>(underlying);
+  return true;
+}
+
+std::vector<std::byte>
+read_file(const std::filesystem::path& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error(fmt::format("Could not open {}", path.string()));
+
+  std::vector<std::byte> contents(std::filesystem::file_size(path));
+  if (!in.read(reinterpret_cast<char*>(contents.data()), static_cast<std::streamsize>(contents.size())))
+    throw std::runtime_error(fmt::format("Could not read {}", path.string()));
+
+  return contents;
+}
+} // namespace
+
+BinaryFileSink::BinaryFileSink(const std::filesystem::path& path)
+  : m_file(path.string(), fmt::file::WRONLY | fmt::file::CREATE | fmt::file::TRUNC)
+{
+  m_buffer.reserve(s_flushSize);
+
+  VectorWriter writer(m_buffer);
+  writer.write(std::as_bytes(std::span(magic)));
+  write_to_buffer(writer, version);
+}
+
+BinaryFileSink::~BinaryFileSink()
+{
+  try {
+    flush();
+  } catch (...) {
+    fmt::print(stderr, "Unable to flush binary file sink\n");
+  }
+}
+
+void
+BinaryFileSink::receive(const LogLevel level, const timestamp_type& ts, const std::string_view line)
+{
+  m_line.clear();
+  VectorWriter writer(m_line);
+  write_to_buffer(writer, line);
+
+  const auto& site = s_lineSites[static_cast<std::size_t>(level)];
+  receive_raw(RawRecord{ &site, site.format, ts, m_line });
+}
+
+void
+BinaryFileSink::receive_raw(const RawRecord& record)
+{
+  const auto id = site_id(record);
+
+  VectorWriter writer(m_buffer);
+  write_to_buffer(writer, EntryType::Record);
+  write_to_buffer(writer, id);
+  write_to_buffer(writer, to_nanos(record.ts));
+  write_to_buffer(writer, static_cast<std::uint32_t>(record.arguments.size()));
+  writer.write(record.arguments);
+
+  if (s_flushSize <= m_buffer.size())
+    flush();
+}
+
+void
+BinaryFileSink::flush()
+{
+  std::size_t written = 0;
+  while (written < m_buffer.size())
+    written += m_file.write(m_buffer.data() + written, m_buffer.size() - written);
+
+  m_bytesWritten += m_buffer.size();
+  m_buffer.clear();
+}
+
+std::uint32_t
+BinaryFileSink::site_id(const RawRecord& record)
+{
+  const SiteKey key{ record.site, record.format.data() };
+  if (const auto it = m_siteIds.find(key); it != m_siteIds.end())
+    return it->second;
+
+  const auto id = static_cast<std::uint32_t>(m_siteIds.size());
+  m_siteIds.emplace(key, id);
+
+  const auto& site = *record.site;
+  VectorWriter writer(m_buffer);
+  write_to_buffer(writer, EntryType::Site);
+  write_to_buffer(writer, id);
+  write_to_buffer(writer, site.level);
+  write_to_buffer(writer, static_cast<std::uint32_t>(site.location.line()));
+  write_to_buffer(writer, static_cast<std::uint32_t>(site.location.column()));
+  write_to_buffer(writer, std::string_view(site.location.file_name()));
+  write_to_buffer(writer, std::string_view(site.location.function_name()));
+  write_to_buffer(writer, record.format);
+  write_to_buffer(writer, static_cast<std::uint32_t>(site.arguments.size()));
+  writer.write(std::as_bytes(site.arguments));
+
+  return id;
+}
+
+void
+hage::decode_binary_log(const std::filesystem::path& path, Sink& sink)
+{
+  const auto contents = read_file(path);
+  SpanReader reader{ std::span(contents) };
+
+  std::vector<DecodedSite> sites;
+  RecordBatch batch;
+  fmt::dynamic_format_arg_store<fmt::format_context> store;
+
+  // The batch is passed on when it gets this large, so the whole log isn't formatted in memory.
+  constexpr std::size_t maxBatchText = 64 * 1024;
+
+  // A log that was cut short, say by a crash, still has its lines up to that point passed on before we throw.
+  const auto invalid = [&path, &sink, &batch](const std::string_view why) {
+    if (!batch.empty())
+      sink.receive_batch(batch.records());
+    return std::runtime_error(fmt::format("{} is not a valid binary log: {}", path.string(), why));
+  };
+
+  std::array<char, BinaryFileSink::magic.size()> magic{};
+  std::uint32_t version{};
+  if (!reader.read(std::as_writable_bytes(std::span(magic))) || !read_from_buffer<std::uint32_t>(reader, version))
+    throw invalid("too short");
+  if (std::string_view(magic.data(), magic.size()) != BinaryFileSink::magic)
+    throw invalid("wrong magic");
+  if (version != BinaryFileSink::version)
+    throw invalid(fmt::format("unsupported version {}", version));
+
+  EntryType type;
+  while (read_enum(reader, type)) {
+    if (type == EntryType::Site) {
+      std::uint32_t id, line, column, argumentCount;
+      DecodedSite site;
+      std::string_view file, function;
+      const bool good = read_from_buffer<std::uint32_t>(reader, id) && read_enum(reader, site.level) &&
+                        read_from_buffer<std::uint32_t>(reader, line) &&
+                        read_from_buffer<std::uint32_t>(reader, column) &&
+                        read_from_buffer<std::string_view>(reader, file) &&
+                        read_from_buffer<std::string_view>(reader, function) &&
+                        read_from_buffer<std::string_view>(reader, site.format) &&
+                        read_from_buffer<std::uint32_t>(reader, argumentCount);
+      if (!good || id != sites.size())
+        throw invalid("corrupt site entry");
+
+      site.location = SourceLocation(file, function, line, column);
+
+      site.arguments.resize(argumentCount);
+      if (!reader.read(std::as_writable_bytes(std::span(site.arguments))))
+        throw invalid("corrupt site entry");
+
+      sites.push_back(std::move(site));
+    } else if (type == EntryType::Record) {
+      std::uint32_t id, argumentsSize;
+      std::int64_t nanos;
+      const bool good = read_from_buffer<std::uint32_t>(reader, id) && read_from_buffer<std::int64_t>(reader, nanos) &&
+                        read_from_buffer<std::uint32_t>(reader, argumentsSize);
+      if (!good || sites.size() <= id)
+        throw invalid("corrupt record");
+
+      std::span<const std::byte> arguments;
+      if (!reader.read_view(argumentsSize, arguments))
+        throw invalid("truncated record");
+
+      const auto& site = sites[id];
+      SpanReader argumentReader{ arguments };
+      store.clear();
+      for (const auto argument : site.arguments) {
+        if (!push_argument(argument, argumentReader, store))
+          throw invalid("corrupt arguments");
+      }
+
+      batch.add(site.level, from_nanos(nanos), site.location, [&site, &store](auto out) {
+        fmt::vformat_to(out, site.format, store);
+      });
+      if (maxBatchText <= batch.text_size()) {
+        sink.receive_batch(batch.records());
+        batch.clear();
+      }
+    } else {
+      throw invalid("unknown entry");
+    }
+  }
+
+  if (!batch.empty())
+    sink.receive_batch(batch.records());
+}
@@ -0,0 +1,89 @@
+#include <hage/logging/clock.hpp>
+
+#include <cmath>
+#include <thread>
+
+using namespace hage;
+
+namespace {
+// Maps the ticks of a clock onto the system clock, from a point where both were read.
+struct Calibration
+{
+  std::uint64_t baseTicks;
+  Sink::timestamp_type baseTime;
+  double nanosPerTick;
+
+  [[nodiscard]] Sink::timestamp_type to_timestamp(const std::uint64_t ticks) const
+  {
+    // The ticks can be from before we calibrated, so the difference is signed.
+    const auto elapsed = static_cast<double>(static_cast<std::int64_t>(ticks - baseTicks)) * nanosPerTick;
+    return baseTime + std::chrono::duration_cast<Sink::timestamp_type::duration>(
+                        std::chrono::nanoseconds(std::llround(elapsed)));
+  }
+};
+
+std::uint64_t
+steady_nanos()
+{
+  return static_cast<std::uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// The coarse clock shares its epoch with CLOCK_MONOTONIC, which we can read precisely when calibrating.
+std::uint64_t
+precise_coarse_ticks()
+{
+#if defined(__linux__)
+  timespec ts{};
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<std::uint64_t>(ts.tv_nsec);
+#else
+  return steady_nanos();
+#endif
+}
+
+const Calibration&
+coarse_calibration()
+{
+  static const Calibration calibration{ precise_coarse_ticks(), std::chrono::system_clock::now(), 1.0 };
+  return calibration;
+}
+
+const Calibration&
+tsc_calibration()
+{
+  static const Calibration calibration = []() {
+    const auto startTicks = TscClock::now();
+    const auto startNanos = steady_nanos();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    const auto endTicks = TscClock::now();
+    const auto endNanos = steady_nanos();
+    const auto endTime = std::chrono::system_clock::now();
+
+    return Calibration{ endTicks,
+                        endTime,
+                        static_cast<double>(endNanos - startNanos) / static_cast<double>(endTicks - startTicks) };
+  }();
+  return calibration;
+}
+} // namespace
+
+Sink::timestamp_type
+CoarseClock::to_timestamp(const std::uint64_t ticks)
+{
+  return coarse_calibration().to_timestamp(ticks);
+}
+
+Sink::timestamp_type
+TscClock::to_timestamp(const std::uint64_t ticks)
+{
+  return tsc_calibration().to_timestamp(ticks);
+}
+
+void
+TscClock::calibrate()
+{
+  static_cast<void>(tsc_calibration());
+}
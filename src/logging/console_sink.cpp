@@ -1,36 +1,23 @@
 
-#include <fmt/chrono.h>
-#include <fmt/color.h>
-#include <fmt/compile.h>
 #include <hage/logging/console_sink.hpp>
 
+#include <cstdio>
+
 using namespace hage;
 
 void
 ConsoleSink::receive(const LogLevel level, const timestamp_type& ts, const std::string_view line)
 {
-  auto logLine = [&line, &ts](const std::string_view& lev, const fmt::color color) {
-    fmt::print(FMT_COMPILE("[{:%F %T %z}] [{: <5}]: {}\n"), ts, styled(lev, fg(color)), line);
-  };
+  const Record record{ level, ts, line, {} };
+  receive_batch(std::span(&record, 1));
+}
+
+void
+ConsoleSink::receive_batch(const std::span<const Record> records)
+{
+  m_buffer.clear();
+  for (const auto& record : records)
+    m_pattern.format(m_buffer, record);
 
-  switch (level) {
-    case LogLevel::Trace:
-      logLine("TRACE", fmt::color::white);
-      break;
-    case LogLevel::Debug:
-      logLine("DEBUG", fmt::color::light_gray);
-      break;
-    case LogLevel::Info:
-      logLine("INFO", fmt::color::green);
-      break;
-    case LogLevel::Warn:
-      logLine("WARN", fmt::color::orange);
-      break;
-    case LogLevel::Error:
-      logLine("ERROR", fmt::color::red);
-      break;
-    case LogLevel::Critical:
-      logLine("CRIT", fmt::color::dark_red);
-      break;
-  }
-}
\ No newline at end of file
+  std::fwrite(m_buffer.data(), 1, m_buffer.size(), stdout);
+}
@@ -1,43 +1,95 @@
-#include <fmt/chrono.h>
-#include <fmt/color.h>
 #include <fmt/core.h>
 #include <hage/logging/file_sink.hpp>
 
+#include <limits>
+#include <utility>
+
+hage::FileSink::FileSink(const std::filesystem::path& path, const FileFlushPolicy policy, const int flags)
+  : FileSink(fmt::file(path.string(), flags), policy)
+{
+}
+
+hage::FileSink::FileSink(fmt::file file, const FileFlushPolicy policy)
+  : m_file(std::move(file))
+  , m_policy{ policy }
+{
+  m_buffer.reserve(m_policy.bufferSize);
+}
+
+hage::FileSink::~FileSink()
+{
+  try {
+    flush();
+  } catch (...) {
+    fmt::print(stderr, "Unable to flush file sink\n");
+  }
+}
+
 void
 hage::FileSink::receive(const LogLevel level, const timestamp_type& ts, const std::string_view line)
 {
-  // TODO(rHermes): The current way of keeping track of how much has been written is
-  // ineffective. It would be better to create some sort of buffer in `fmt` that allowed
-  // us to get the size written directly. If profiling shows this to be the weak link, I'll implement
-  // it then.
-  auto logLine = [&line, &ts, this](const std::string_view& lev) {
-    m_out.print("[{:%F %T %z}] [{: <5}]: {}\n", ts, lev, line);
-    m_bytesWritten += fmt::formatted_size("[{:%F %T %z}] [{: <5}]: {}\n", ts, lev, line);
-  };
-
-  switch (level) {
-    case LogLevel::Trace:
-      logLine("TRACE");
-      break;
-    case LogLevel::Debug:
-      logLine("DEBUG");
-      break;
-    case LogLevel::Info:
-      logLine("INFO");
-      break;
-    case LogLevel::Warn:
-      logLine("WARN");
-      break;
-    case LogLevel::Error:
-      logLine("ERROR");
-      break;
-    case LogLevel::Critical:
-      logLine("CRIT");
+  const Record record{ level, ts, line, {} };
+  receive_batch(std::span(&record, 1));
+}
+
+void
+hage::FileSink::receive_batch(const std::span<const Record> records)
+{
+  receive_until(records, std::numeric_limits<std::size_t>::max());
+}
+
+std::size_t
+hage::FileSink::receive_until(const std::span<const Record> records, const std::size_t maxBytes)
+{
+  if (records.empty())
+    return 0;
+
+  if (m_buffer.size() == 0)
+    m_oldestBuffered = records.front().ts;
+
+  // The lines are formatted once, straight into the buffer, so the growth of the buffer is exactly what we write.
+  const auto before = m_buffer.size();
+  bool urgent = false;
+  std::size_t taken = 0;
+  while (taken < records.size()) {
+    const auto& record = records[taken++];
+    m_pattern.format(m_buffer, record);
+    urgent = urgent || m_policy.flushLevel <= record.level;
+
+    if (maxBytes <= m_bytesWritten + (m_buffer.size() - before))
       break;
   }
+  m_bytesWritten += m_buffer.size() - before;
+
+  const auto& last = records[taken - 1];
+  if (urgent || m_policy.bufferSize <= m_buffer.size() || m_policy.maxDelay <= last.ts - m_oldestBuffered)
+    flush();
+
+  return taken;
 }
+
+void
+hage::FileSink::on_idle(const timestamp_type& now)
+{
+  if (m_buffer.size() != 0 && m_policy.maxDelay <= now - m_oldestBuffered)
+    flush();
+}
+
 void
 hage::FileSink::flush()
 {
-  m_out.flush();
-}
\ No newline at end of file
+  std::size_t written = 0;
+  while (written < m_buffer.size())
+    written += m_file.write(m_buffer.data() + written, m_buffer.size() - written);
+
+  m_buffer.clear();
+}
+
+fmt::file
+hage::FileSink::swap_file(fmt::file next)
+{
+  flush();
+  std::swap(m_file, next);
+  m_bytesWritten = 0;
+  return next;
+}
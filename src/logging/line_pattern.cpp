@@ -0,0 +1,144 @@
+#include <fmt/color.h>
+#include <fmt/compile.h>
+#include <hage/logging/line_pattern.hpp>
+
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+using namespace hage;
+
+LinePattern::LinePattern(const std::string_view pattern, const LevelStyle style)
+{
+  const auto fail = [pattern](const std::string_view reason) {
+    throw std::runtime_error(fmt::format("Invalid log line pattern \"{}\": {}", pattern, reason));
+  };
+
+  std::size_t pos = 0;
+  while (pos < pattern.size()) {
+    const auto special = pattern.find_first_of("{}", pos);
+    add_literal(pattern.substr(pos, special - pos));
+    if (special == std::string_view::npos)
+      break;
+
+    // Escaped braces are kept as literal text.
+    if (special + 1 < pattern.size() && pattern[special + 1] == pattern[special]) {
+      add_literal(pattern.substr(special, 1));
+      pos = special + 2;
+      continue;
+    }
+
+    if (pattern[special] == '}')
+      fail("unmatched '}'");
+
+    const auto close = pattern.find('}', special);
+    if (close == std::string_view::npos)
+      fail("unmatched '{'");
+
+    const auto spec = pattern.substr(special + 1, close - special - 1);
+    const auto colon = spec.find(':');
+    const auto name = spec.substr(0, colon);
+    const auto argument = colon == std::string_view::npos ? std::string_view{} : spec.substr(colon + 1);
+
+    Field field{};
+    if (name == "time") {
+      field = Field::Time;
+      if (argument == "s")
+        m_timestamps.set_precision(TimestampPrecision::Seconds);
+      else if (argument == "ms")
+        m_timestamps.set_precision(TimestampPrecision::Milliseconds);
+      else if (argument == "us")
+        m_timestamps.set_precision(TimestampPrecision::Microseconds);
+      else if (argument == "ns")
+        m_timestamps.set_precision(TimestampPrecision::Nanoseconds);
+      else if (!argument.empty())
+        fail("the precision of {time} has to be s, ms, us or ns");
+    } else if (name == "level") {
+      field = Field::Level;
+    } else if (name == "thread") {
+      field = Field::Thread;
+    } else if (name == "file") {
+      field = Field::File;
+    } else if (name == "line") {
+      field = Field::Line;
+    } else if (name == "function") {
+      field = Field::Function;
+    } else if (name == "message") {
+      field = Field::Message;
+    } else {
+      fail(fmt::format("unknown field {{{}}}", spec));
+    }
+
+    if (field != Field::Time && colon != std::string_view::npos)
+      fail(fmt::format("{{{}}} takes no arguments", name));
+
+    m_operations.push_back(Operation{ field, 0, 0 });
+    pos = close + 1;
+  }
+
+  // The levels are formatted up front, with their padding and colors, so writing one is a copy.
+  constexpr std::array<std::pair<std::string_view, fmt::color>, 6> levels{ {
+    { "TRACE", fmt::color::white },
+    { "DEBUG", fmt::color::light_gray },
+    { "INFO", fmt::color::green },
+    { "WARN", fmt::color::orange },
+    { "ERROR", fmt::color::red },
+    { "CRIT", fmt::color::dark_red },
+  } };
+  for (std::size_t i = 0; i < levels.size(); i++) {
+    const auto& [name, color] = levels[i];
+    m_levels[i] = style == LevelStyle::Colored ? fmt::format("{: <5}", styled(name, fg(color)))
+                                               : fmt::format("{: <5}", name);
+  }
+}
+
+void
+LinePattern::add_literal(const std::string_view text)
+{
+  if (text.empty())
+    return;
+
+  // Runs of text are merged, so escapes don't split them into several copies.
+  if (!m_operations.empty() && m_operations.back().field == Field::Literal) {
+    m_operations.back().size += static_cast<std::uint32_t>(text.size());
+  } else {
+    m_operations.push_back(
+      Operation{ Field::Literal, static_cast<std::uint32_t>(m_literals.size()), static_cast<std::uint32_t>(text.size()) });
+  }
+  m_literals.append(text);
+}
+
+void
+LinePattern::format(fmt::memory_buffer& out, const Sink::Record& record)
+{
+  const auto append = [&out](const std::string_view text) { out.append(text.data(), text.data() + text.size()); };
+
+  for (const auto& op : m_operations) {
+    switch (op.field) {
+      case Field::Literal:
+        append(std::string_view(m_literals).substr(op.offset, op.size));
+        break;
+      case Field::Time:
+        m_timestamps.append(out, record.ts);
+        break;
+      case Field::Level:
+        append(m_levels[static_cast<std::size_t>(record.level)]);
+        break;
+      case Field::Thread:
+        fmt::format_to(std::back_inserter(out), FMT_COMPILE("{}"), record.thread);
+        break;
+      case Field::File:
+        append(record.location.file_name());
+        break;
+      case Field::Line:
+        fmt::format_to(std::back_inserter(out), FMT_COMPILE("{}"), record.location.line());
+        break;
+      case Field::Function:
+        append(record.location.function_name());
+        break;
+      case Field::Message:
+        append(record.line);
+        break;
+    }
+  }
+}
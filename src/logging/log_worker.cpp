@@ -0,0 +1,94 @@
+#include <hage/logging/log_worker.hpp>
+
+using namespace hage;
+
+LogWorker::LogWorker()
+  : LogWorker(IdlePolicy{})
+{
+}
+
+LogWorker::LogWorker(const IdlePolicy policy, const std::size_t batchSize)
+  : m_policy{ policy }
+  , m_batchSize{ batchSize }
+  , m_thread([this](const std::stop_token& stopToken) { run(stopToken); })
+{
+}
+
+LogWorker::~LogWorker()
+{
+  stop();
+}
+
+void
+LogWorker::stop()
+{
+  if (m_thread.joinable()) {
+    m_thread.request_stop();
+    m_thread.join();
+  }
+
+  std::scoped_lock lock(m_mutex);
+  for (const auto& source : m_sources)
+    source.detach(source.logger);
+  m_sources.clear();
+}
+
+void
+LogWorker::run(const std::stop_token& stopToken)
+{
+  std::stop_callback wakeOnStop(stopToken, [this]() { m_signal.wake(); });
+
+  std::size_t idlePolls = 0;
+  while (!stopToken.stop_requested()) {
+    if (0 < poll()) {
+      idlePolls = 0;
+      continue;
+    }
+
+    if (idlePolls < m_policy.spins) {
+      cpu_relax();
+      idlePolls++;
+    } else if (idlePolls < m_policy.spins + m_policy.yields) {
+      std::this_thread::yield();
+      idlePolls++;
+    } else {
+      idle();
+
+      // We have to check one last time after telling the producers we are parking, or we could miss a wakeup. Only
+      // something to read starts the spinning over, after a timeout we go straight back to parking.
+      const auto epoch = m_signal.prepare_park();
+      if (0 < poll() || stopToken.stop_requested()) {
+        m_signal.cancel_park();
+        idlePolls = 0;
+      } else if (m_signal.park_for(epoch, m_policy.idleInterval)) {
+        idlePolls = 0;
+      }
+    }
+  }
+
+  // We drain everything before exiting.
+  while (0 < poll()) {
+  }
+}
+
+std::size_t
+LogWorker::poll()
+{
+  std::scoped_lock lock(m_mutex);
+
+  std::size_t records = 0;
+  for (const auto& source : m_sources)
+    records += source.read(source.logger, m_batchSize);
+
+  return records;
+}
+
+void
+LogWorker::idle()
+{
+  std::scoped_lock lock(m_mutex);
+
+  const auto now = std::chrono::system_clock::now();
+  for (const auto& source : m_sources)
+    source.idle(source.logger, now);
+}
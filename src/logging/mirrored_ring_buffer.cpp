@@ -0,0 +1,61 @@
+#include <hage/logging/mirrored_ring_buffer.hpp>
+
+#if HAGE_HAS_MIRRORED_RING_BUFFER
+
+#include <cerrno>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace hage;
+
+namespace {
+[[noreturn]] void
+throw_errno(const char* what)
+{
+  throw std::system_error(errno, std::system_category(), what);
+}
+
+// Closes the memfd when we leave the constructor, the mappings keep the memory alive.
+struct ScopedFd final
+{
+  int fd;
+  ~ScopedFd() { ::close(fd); }
+};
+} // namespace
+
+MirroredRingBuffer::MirroredRingBuffer(const std::size_t minCapacity)
+{
+  const auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  m_capacity = std::max<std::size_t>(1, (minCapacity + pageSize - 1) / pageSize) * pageSize;
+
+  const ScopedFd memory{ ::memfd_create("hage_mirrored_ring_buffer", MFD_CLOEXEC) };
+  if (memory.fd == -1)
+    throw_errno("memfd_create");
+
+  if (::ftruncate(memory.fd, static_cast<off_t>(m_capacity)) == -1)
+    throw_errno("ftruncate");
+
+  // We first reserve enough address space for both views, and then map the memory over it twice.
+  auto* base = ::mmap(nullptr, 2 * m_capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    throw_errno("mmap");
+
+  m_data = static_cast<std::byte*>(base);
+
+  for (auto* view : { m_data, m_data + m_capacity }) {
+    if (::mmap(view, m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memory.fd, 0) == MAP_FAILED) {
+      const auto err = errno;
+      ::munmap(base, 2 * m_capacity);
+      throw std::system_error(err, std::system_category(), "mmap");
+    }
+  }
+}
+
+MirroredRingBuffer::~MirroredRingBuffer()
+{
+  ::munmap(m_data, 2 * m_capacity);
+}
+
+#endif
@@ -1,42 +1,132 @@
+#include "fmt/chrono.h"
 #include "fmt/core.h"
 #include "fmt/std.h"
 
 #include <hage/core/assert.hpp>
 #include <hage/logging/rotating_file_sink.hpp>
-#include <iostream>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 using namespace hage;
 
+namespace {
+constexpr int s_fileFlags = fmt::file::WRONLY | fmt::file::CREATE | fmt::file::TRUNC;
+
+int
+process_id()
+{
+#if defined(_WIN32)
+  return ::_getpid();
+#else
+  return static_cast<int>(::getpid());
+#endif
+}
+
+// Gives back the space reserved past the end of the file, before closing it.
 void
-RotatingFileSink::receive(LogLevel level, const Sink::timestamp_type& ts, std::string_view line)
+close_file(fmt::file file)
 {
-  if (!m_currentFile) {
-    throw std::runtime_error("Trying to log to a RotatingFileSink without a file");
-  }
+#if defined(__linux__)
+  struct stat st
+  {};
+  if (::fstat(file.descriptor(), &st) == 0)
+    static_cast<void>(::ftruncate(file.descriptor(), st.st_size));
+#endif
+  file.close();
+}
 
-  m_currentFile->receive(level, ts, line);
+// How far ahead of UTC the local time is at the given time.
+std::chrono::seconds
+utc_offset(const Sink::timestamp_type& ts)
+{
+  const auto time = std::chrono::system_clock::to_time_t(ts);
+  std::tm local{};
+#if defined(_WIN32)
+  ::localtime_s(&local, &time);
+  std::tm utc{};
+  ::gmtime_s(&utc, &time);
+  return std::chrono::seconds(static_cast<std::int64_t>(std::difftime(std::mktime(&local), std::mktime(&utc))));
+#else
+  ::localtime_r(&time, &local);
+  return std::chrono::seconds(local.tm_gmtoff);
+#endif
+}
+} // namespace
 
-  LogFileStats stats{
-    .bytes = m_currentFile->bytes_written(),
-  };
+void
+RotatingFileSink::receive(const LogLevel level, const Sink::timestamp_type& ts, const std::string_view line)
+{
+  const Record record{ level, ts, line, {} };
+  receive_batch(std::span(&record, 1));
+}
 
-  if (m_rotater->shouldRotate(stats))
-    rotate(stats);
+void
+RotatingFileSink::receive_batch(const std::span<const Record> records)
+{
+  auto rest = records;
+  while (!rest.empty()) {
+    // The run ends at the first line at or past the rotation time, or earlier if it fills the file.
+    const auto next = m_rotater->nextRotation();
+    const auto due = std::ranges::find_if(rest, [&next](const Record& record) { return next.ts <= record.ts; });
+    const auto run = due == rest.end() ? rest.size() : static_cast<std::size_t>(due - rest.begin()) + 1;
+    const auto taken = m_currentFile->receive_until(rest.first(run), next.bytes);
+
+    const LogFileStats stats{
+      .bytes = m_currentFile->bytes_written(),
+      .ts = rest[taken - 1].ts,
+    };
+    rest = rest.subspan(taken);
+
+    if (m_rotater->shouldRotate(stats))
+      rotate(stats);
+  }
+}
+
+void
+RotatingFileSink::on_idle(const Sink::timestamp_type& now)
+{
+  m_currentFile->on_idle(now);
 }
 
 RotatingFileSink::RotatingFileSink(Config conf, std::unique_ptr<Rotater> rotater)
   : m_conf{ std::move(conf) }
   , m_rotater{ std::move(rotater) }
 {
-  if (m_conf.valid()) {
+  if (!m_conf.valid() || !m_rotater) {
     throw std::runtime_error("Invalid configuration");
   }
 
-  constexpr LogFileStats stats{
+  std::filesystem::create_directories(m_conf.saveDirectory);
+
+  const LogFileStats stats{
     .bytes = 0,
+    .ts = std::chrono::system_clock::now(),
   };
 
-  rotate(stats);
+  // Setting up is done here, so there is a file to write to straight away.
+  const auto names = m_rotater->generateNames(stats, m_conf.maxNumber + 1);
+  HAGE_ASSERT(!names.empty(), "Names should never be empty");
+  move_files(names);
+
+  m_currentFile.emplace(fmt::file((m_conf.saveDirectory / names.front()).string(), s_fileFlags), m_conf.policy);
+  m_currentFile->set_pattern(LinePattern(m_conf.pattern));
+  m_currentFile->set_timestamp_precision(m_conf.precision);
+  m_prepared = prepare_file();
+
+  m_worker = std::jthread([this](const std::stop_token& stop) { run(stop); });
 }
 
 void
@@ -45,33 +135,141 @@ RotatingFileSink::flush()
   if (m_currentFile) {
     m_currentFile->flush();
   }
+
+  std::unique_lock lock(m_mutex);
+  m_changed.wait(lock, [this]() { return (m_rotations.empty() && !m_busy) || m_error; });
+  if (m_error)
+    std::rethrow_exception(std::exchange(m_error, nullptr));
 }
 
 RotatingFileSink::~RotatingFileSink()
 {
   try {
+    flush();
+    m_worker = {};
     m_currentFile.reset();
+    if (m_prepared) {
+      const auto path = m_prepared->path;
+      m_prepared.reset();
+      std::filesystem::remove(path);
+    }
   } catch (...) {
-    fmt::print(std::cerr, "Unable to flush rotating file sink");
+    fmt::print(stderr, "Unable to flush rotating file sink\n");
   }
 }
 
 void
 RotatingFileSink::rotate(const LogFileStats& stats)
 {
-  // ok, here we go lads.
-  const auto type = m_rotater->getRotateType();
+  // The file is taken first, so a rotater doesn't remember a name for a rotation that failed.
+  auto next = take_prepared();
 
   // We generate +1 names always
-  const auto names = m_rotater->generateNames(stats, m_conf.maxNumber + 1);
+  auto names = m_rotater->generateNames(stats, m_conf.maxNumber + 1);
   HAGE_ASSERT(!names.empty(), "Names should never be empty");
 
-  /*
-  if (type == Rotater::Type::MoveBackwards) {
-    // The first here is the newest. That is the one we will open a new.
-    for (std::size_t N = names.size())
+  auto previous = m_currentFile->swap_file(std::move(next.file));
+  {
+    std::scoped_lock lock(m_mutex);
+    m_rotations.push_back(Rotation{ std::move(previous), std::move(next.path), std::move(names) });
+  }
+  m_changed.notify_all();
+}
+
+RotatingFileSink::PreparedFile
+RotatingFileSink::take_prepared()
+{
+  std::unique_lock lock(m_mutex);
+  m_changed.wait(lock, [this]() { return m_prepared || m_error || (m_rotations.empty() && !m_busy); });
+  if (m_error)
+    std::rethrow_exception(std::exchange(m_error, nullptr));
+
+  if (m_prepared) {
+    auto prepared = std::move(*m_prepared);
+    m_prepared.reset();
+    return prepared;
+  }
+
+  // The background thread couldn't prepare one, and has told us so already, so we try again ourselves.
+  lock.unlock();
+  return prepare_file();
+}
+
+void
+RotatingFileSink::move_files(const std::vector<std::filesystem::path>& names) const
+{
+  const auto path = [this](const std::filesystem::path& name) { return m_conf.saveDirectory / name; };
+
+  if (m_rotater->getRotateType() == Rotater::Type::MoveBackwards) {
+    // The last name is the one past what we keep, so the file before it is dropped by renaming over it.
+    std::filesystem::remove(path(names.back()));
+    for (std::size_t i = names.size() - 2; 0 < i && i < names.size(); i--) {
+      if (std::filesystem::exists(path(names[i - 1])))
+        std::filesystem::rename(path(names[i - 1]), path(names[i]));
+    }
+  } else if (static_cast<int>(names.size()) == m_conf.maxNumber + 1) {
+    std::filesystem::remove(path(names.back()));
+  }
+}
+
+RotatingFileSink::PreparedFile
+RotatingFileSink::prepare_file() const
+{
+  // The process id keeps sinks in other processes, rotating in the same directory, from using the same name.
+  static std::atomic<std::uint64_t> counter{ 0 };
+  auto path = m_conf.saveDirectory / fmt::format(".hage_rotating_{}_{}.next", process_id(), counter.fetch_add(1));
+
+  fmt::file file(path.string(), s_fileFlags);
+#if defined(__linux__)
+  // Not all filesystems can do this, and then we just go without.
+  if (0 < m_conf.preallocate)
+    static_cast<void>(
+      ::fallocate(file.descriptor(), FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(m_conf.preallocate)));
+#endif
+  return PreparedFile{ std::move(file), std::move(path) };
+}
+
+void
+RotatingFileSink::run(const std::stop_token& stop)
+{
+  while (true) {
+    std::optional<Rotation> rotation;
+    {
+      std::unique_lock lock(m_mutex);
+      if (!m_changed.wait(lock, stop, [this]() { return !m_rotations.empty(); }))
+        return;
+
+      rotation.emplace(std::move(m_rotations.front()));
+      m_rotations.pop_front();
+      m_busy = true;
+    }
+
+    std::exception_ptr error;
+    try {
+      close_file(std::move(rotation->previous));
+      move_files(rotation->names);
+      std::filesystem::rename(rotation->current, m_conf.saveDirectory / rotation->names.front());
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    // The next file is prepared even when the rotation failed, so the log thread has something to rotate to.
+    std::optional<PreparedFile> prepared;
+    try {
+      prepared = prepare_file();
+    } catch (...) {
+      error = error ? error : std::current_exception();
+    }
+
+    {
+      std::scoped_lock lock(m_mutex);
+      m_busy = false;
+      if (error)
+        m_error = error;
+      m_prepared = std::move(prepared);
+    }
+    m_changed.notify_all();
   }
-  */
 }
 
 bool
@@ -91,7 +289,7 @@ SizeRotater::generateNames(const LogFileStats&, int times)
   ans.push_back(m_base);
 
   for (int i = 1; i < times; i++) {
-    ans.emplace_back(fmt::format("{}.{}", m_base, i));
+    ans.emplace_back(fmt::format("{}.{}", m_base.string(), i));
   }
 
   return ans;
@@ -103,16 +301,33 @@ SizeRotater::SizeRotater(std::filesystem::path base, const std::size_t maxSize)
 {
 }
 
-TimeRotater::TimeRotater(fmt_string base) : m_format{ std::move(base) } {}
-
-bool
-TimeRotater::shouldRotate(const LogFileStats& stats)
+TimeRotater::TimeRotater(fmt_string base, const std::chrono::seconds period, const Zone zone)
+  : m_format{ std::move(base) }
+  , m_period{ period }
+  , m_zone{ zone }
 {
-  return false;
 }
 
 std::vector<std::filesystem::path>
-TimeRotater::generateNames(const LogFileStats& stats, int times)
+TimeRotater::generateNames(const LogFileStats& stats, const int times)
 {
-  return {};
+  if (times <= 0)
+    return {};
+
+  // Local time is handled by moving the timestamps by the UTC offset, so the periods line up with the local midnight.
+  const auto offset = [this](const Sink::timestamp_type& ts) {
+    return m_zone == Zone::Local ? utc_offset(ts) : std::chrono::seconds(0);
+  };
+
+  const auto local = std::chrono::floor<std::chrono::seconds>(stats.ts) + offset(stats.ts);
+  const auto start = local - (local.time_since_epoch() % m_period);
+  const auto next = start + m_period;
+  m_nextRotation = next - offset(next - offset(stats.ts));
+
+  const std::chrono::system_clock::time_point name = start;
+  m_previous.insert(m_previous.begin(), fmt::vformat(m_format.get(), fmt::make_format_args(name)));
+  if (static_cast<int>(m_previous.size()) > times)
+    m_previous.resize(static_cast<std::size_t>(times));
+
+  return m_previous;
 }
@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <source_location>
+#include <stdexcept>
+#include <string>
+
+#include <hage/logging/binary_file_sink.hpp>
+#include <hage/logging/file_sink.hpp>
+#include <hage/logging/log_macros.hpp>
+#include <hage/logging/logger.hpp>
+#include <hage/logging/ring_buffer.hpp>
+#include <hage/logging/vector_buffer.hpp>
+
+#include <doctest/doctest.h>
+
+#include "test_sink.hpp"
+#include "test_utils.hpp"
+
+using namespace hage::literals;
+
+namespace {
+// Enums aren't described, so lines with them are formatted by the logger.
+enum class Color
+{
+  Red,
+  Green
+};
+
+} // namespace
+
+template<>
+struct fmt::formatter<Color> : fmt::formatter<std::string_view>
+{
+  auto format(const Color color, fmt::format_context& ctx) const
+  {
+    return fmt::formatter<std::string_view>::format(color == Color::Red ? "red" : "green", ctx);
+  }
+};
+
+TEST_SUITE_BEGIN("logging");
+
+TEST_CASE_TEMPLATE("Binary file sink", Buffer, hage::RingBuffer<4096>, hage::VectorBuffer)
+{
+  const hage::test::ScopedTempFile tempFile("binary_file_sink_test.{}.bin");
+  hage::test::TestSink testSink;
+
+  {
+    hage::BinaryFileSink sink(tempFile.path);
+    Buffer buffer;
+    hage::Logger logger(&buffer, &sink);
+    logger.set_min_log_level(hage::LogLevel::Trace);
+
+    for (int i = 0; i < 2; i++)
+      logger.info("{} {} {} {} {}", i, -2LL, 3.5, 'c', true);
+
+    logger.warn("{}, {}!"_fmt, "Hello", std::string("world"));
+    logger.debug("{:>4}|{:.2f}", 7u, 2.5f);
+    HAGE_LOG_ERROR(logger, "from a macro: {}", std::uint8_t{ 200 });
+    logger.critical("the color is {}", Color::Green);
+
+    REQUIRE_EQ(logger.drain(), 6);
+  }
+
+  hage::decode_binary_log(tempFile.path, testSink);
+  REQUIRE_EQ(testSink.size(), 6);
+  testSink.require_info("0 -2 3.5 c true");
+  testSink.require_info("1 -2 3.5 c true");
+  testSink.require_warn("Hello, world!");
+  testSink.require_debug("   7|2.50");
+  testSink.require_error("from a macro: 200");
+  testSink.require_critical("the color is green");
+}
+
+TEST_CASE("Binary log decoding should keep the call site")
+{
+  const hage::test::ScopedTempFile binaryFile("binary_file_sink_test.{}.bin");
+  const hage::test::ScopedTempFile textFile("binary_file_sink_test.{}.txt");
+
+  std::uint32_t line;
+  {
+    hage::BinaryFileSink sink(binaryFile.path);
+    hage::RingBuffer<4096> buffer;
+    hage::Logger logger(&buffer, &sink);
+
+    line = std::source_location::current().line() + 1;
+    HAGE_LOG_INFO(logger, "here");
+    REQUIRE_EQ(logger.drain(), 1);
+  }
+
+  {
+    hage::FileSink fs(textFile.path);
+    fs.set_pattern(hage::LinePattern("{file}|{line}|{function}|{message}\n"));
+    hage::decode_binary_log(binaryFile.path, fs);
+  }
+
+  const auto here = std::source_location::current();
+  std::ifstream in(textFile.path);
+  std::string decoded;
+  REQUIRE_UNARY(std::getline(in, decoded));
+  REQUIRE_EQ(decoded, fmt::format("{}|{}|{}|here", here.file_name(), line, here.function_name()));
+}
+
+TEST_CASE("Binary log decoding should reject other files")
+{
+  const hage::test::ScopedTempFile tempFile("binary_file_sink_test.{}.txt");
+  {
+    std::ofstream out(tempFile.path);
+    out << "This is not a binary log\n";
+  }
+
+  hage::test::TestSink testSink;
+  REQUIRE_THROWS_AS(hage::decode_binary_log(tempFile.path, testSink), std::runtime_error);
+  REQUIRE_UNARY(testSink.empty());
+}
+
+#if defined(__linux__)
+TEST_CASE("Binary file sink should not throw from its destructor")
+{
+  // Every write to /dev/full fails, so the flush in the destructor does too.
+  REQUIRE_NOTHROW([]() {
+    hage::BinaryFileSink sink("/dev/full");
+    sink.receive(hage::LogLevel::Info, std::chrono::system_clock::now(), "Never written");
+  }());
+}
+#endif
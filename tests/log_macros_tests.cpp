@@ -0,0 +1,91 @@
+// Everything below warn is compiled out in this file.
+#define HAGE_ACTIVE_LOG_LEVEL HAGE_LOG_LEVEL_WARN
+
+#include <hage/logging/log_macros.hpp>
+#include <hage/logging/multi_producer_logger.hpp>
+#include <hage/logging/ring_buffer.hpp>
+
+#include <doctest/doctest.h>
+
+#include "test_sink.hpp"
+
+using namespace hage::literals;
+
+TEST_SUITE_BEGIN("logging");
+
+TEST_CASE("Log macros")
+{
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &sink);
+  logger.set_min_log_level(hage::LogLevel::Trace);
+
+  int evaluated = 0;
+  const auto count = [&evaluated]() { return ++evaluated; };
+
+  SUBCASE("Statements below the active level should not evaluate their arguments")
+  {
+    HAGE_LOG_TRACE(logger, "trace {}", count());
+    HAGE_LOG_DEBUG(logger, "debug {}", count());
+    HAGE_LOG_INFO(logger, "info {}", count());
+    HAGE_LOG_WARN(logger, "warn {}", count());
+    HAGE_LOG_ERROR(logger, "error {} {}", count(), "hermes");
+    HAGE_LOG_CRITICAL(logger, "critical");
+
+    REQUIRE_EQ(evaluated, 2);
+    REQUIRE_EQ(logger.drain(), 3);
+    sink.require_warn("warn 1");
+    sink.require_error("error 2 hermes");
+    sink.require_critical("critical");
+    REQUIRE_UNARY(sink.empty());
+  }
+
+  SUBCASE("Statements below the min log level should not evaluate their arguments")
+  {
+    logger.set_min_log_level(hage::LogLevel::Error);
+    HAGE_LOG_WARN(logger, "warn {}", count());
+    HAGE_LOG_ERROR(logger, "error {}", count());
+
+    REQUIRE_EQ(evaluated, 1);
+    REQUIRE_EQ(logger.drain(), 1);
+    sink.require_error("error 1");
+  }
+
+  SUBCASE("The sink should get the source location")
+  {
+    const auto line = std::source_location::current().line() + 1;
+    HAGE_LOG_WARN(logger, "here");
+
+    REQUIRE_EQ(logger.drain(), 1);
+    REQUIRE_EQ(sink.front_location().line(), line);
+    REQUIRE_UNARY(std::string_view(sink.front_location().file_name()).ends_with("log_macros_tests.cpp"));
+    sink.require_warn("here");
+  }
+
+  SUBCASE("Each statement should get its own site")
+  {
+    for (int i = 0; i < 3; i++) {
+      HAGE_LOG_WARN(logger, "first {}", i);
+      HAGE_LOG_WARN(logger, "second {}", i);
+    }
+
+    REQUIRE_EQ(logger.drain(), 6);
+    for (int i = 0; i < 3; i++) {
+      sink.require_warn(fmt::format("first {}", i));
+      sink.require_warn(fmt::format("second {}", i));
+    }
+  }
+
+  SUBCASE("They should work with the multi producer logger")
+  {
+    hage::MultiProducerLogger<hage::RingBuffer<4096>> multiLogger(&sink);
+    HAGE_LOG_DEBUG(multiLogger, "debug {}", count());
+    HAGE_LOG_WARN(multiLogger, "warn {}", count());
+
+    REQUIRE_EQ(evaluated, 1);
+    REQUIRE_EQ(multiLogger.drain(), 1);
+    sink.require_warn("warn 1");
+  }
+}
+
+TEST_SUITE_END();
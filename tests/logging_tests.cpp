@@ -1,13 +1,25 @@
+#include <array>
 #include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <functional>
 #include <latch>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
 #include <thread>
+#include <tuple>
+#include <variant>
+#include <vector>
 
 #include <hage/core/misc.hpp>
 
 #include <hage/logging.hpp>
+#include <hage/logging/async_file_sink.hpp>
 #include <hage/logging/file_sink.hpp>
+#include <hage/logging/log_worker.hpp>
 #include <hage/logging/ring_buffer.hpp>
 #include <hage/logging/vector_buffer.hpp>
 
@@ -262,6 +274,147 @@ TEST_CASE_TEMPLATE("Single producer, single consumer buffers", BufferType, hage:
 }
 #endif
 
+TEST_CASE("Strings should be read back as views")
+{
+  std::array<std::byte, 64> storage{};
+
+  hage::SpanWriter writer(storage);
+  REQUIRE_UNARY(hage::write_to_buffer(writer, "hello"));
+  REQUIRE_UNARY(hage::write_to_buffer(writer, std::string("there")));
+
+  SUBCASE("SpanReader should point into the record")
+  {
+    hage::SpanReader reader{ std::span(storage).first(writer.bytes_written()) };
+    std::string_view first, second;
+    REQUIRE_UNARY(hage::read_from_buffer<std::string_view>(reader, first));
+    REQUIRE_UNARY(hage::read_from_buffer<std::string_view>(reader, second));
+    REQUIRE_EQ(first, "hello");
+    REQUIRE_EQ(second, "there");
+
+    const auto* begin = reinterpret_cast<const char*>(storage.data());
+    REQUIRE_UNARY(begin <= first.data() && first.data() < begin + storage.size());
+    REQUIRE_UNARY_FALSE(hage::read_from_buffer<std::string_view>(reader, first));
+  }
+
+  SUBCASE("ArenaReader should copy into the arena")
+  {
+    hage::SpanReader inner{ std::span(storage).first(writer.bytes_written()) };
+
+    std::array<std::byte, 8> arena{};
+    hage::ArenaReader reader(inner, arena);
+    std::string_view first, second;
+    REQUIRE_UNARY(hage::read_from_buffer<std::string_view>(reader, first));
+    REQUIRE_EQ(first, "hello");
+    REQUIRE_EQ(static_cast<const void*>(first.data()), static_cast<const void*>(arena.data()));
+
+    // There is only room for 3 more bytes in the arena.
+    REQUIRE_UNARY_FALSE(hage::read_from_buffer<std::string_view>(reader, second));
+  }
+}
+
+namespace {
+// fmt can't format this, so it is logged as its underlying type.
+enum class Side : std::uint8_t
+{
+  Buy,
+  Sell
+};
+} // namespace
+
+TEST_CASE_TEMPLATE("Standard library types should be serialized", Buffer, hage::RingBuffer<4096>, hage::VectorBuffer)
+{
+  static_assert(hage::BitwiseSerializable<std::int32_t>);
+  static_assert(hage::BitwiseSerializable<std::array<double, 4>>);
+  static_assert(hage::BitwiseSerializable<std::chrono::milliseconds>);
+  static_assert(!hage::BitwiseSerializable<std::string_view>);
+  static_assert(!hage::BitwiseSerializable<Side>);
+  static_assert(hage::encoded_size(std::array<std::int32_t, 3>{}) == 12);
+  static_assert(hage::encoded_size(std::optional<std::int32_t>{}) == 1);
+  REQUIRE_EQ(hage::encoded_size(std::vector<std::int32_t>{ 1, 2, 3 }), sizeof(std::size_t) + 12);
+
+  using namespace std::chrono_literals;
+
+  hage::test::TestSink sink;
+  Buffer buffer;
+  hage::Logger logger(&buffer, &sink);
+
+  // The char leaves the ranges unaligned in the buffer.
+  const std::vector<double> doubles{ 1.5, 2.5 };
+  const std::int32_t raw[] = { 4, 5 };
+  logger.info("{} {} {} {} {}",
+              'c',
+              doubles,
+              std::array<std::int32_t, 3>{ 1, 2, 3 },
+              raw,
+              std::span<const double>(doubles).first(1));
+  logger.info("{} {}"_fmt, std::vector<std::int64_t>{}, std::vector<std::chrono::milliseconds>{ 1ms, 2ms });
+
+  logger.info("{} {} {}", std::optional<int>(7), std::optional<int>(), std::optional<double>(2.5));
+  logger.info("{} {} {}",
+              std::variant<int, std::string>(3),
+              std::variant<int, std::string>("a"),
+              std::variant<std::monostate, int>());
+  logger.info("{} {}", std::pair<int, std::string>(1, "one"), std::tuple<int, double, char>(1, 2.5, 'c'));
+
+  const std::chrono::time_point<std::chrono::steady_clock, std::chrono::seconds> steady(std::chrono::seconds(5));
+  const std::chrono::sys_seconds system(std::chrono::seconds(90));
+  logger.info("{} {:%H:%M:%S} {} {}", std::chrono::milliseconds(42), system, steady, Side::Sell);
+
+  REQUIRE_EQ(logger.drain(), 6);
+  sink.require_info("c [1.5, 2.5] [1, 2, 3] [4, 5] [1.5]");
+  sink.require_info("[] [1ms, 2ms]");
+  sink.require_info("optional(7) none optional(2.5)");
+  sink.require_info("variant(3) variant(\"a\") variant(monostate)");
+  sink.require_info("(1, \"one\") (1, 2.5, 'c')");
+  sink.require_info("42ms 00:01:30 5s 1");
+  REQUIRE_UNARY(sink.empty());
+}
+
+namespace {
+struct Quote
+{
+  std::uint32_t instrument;
+  char side;
+  double price;
+  std::int64_t quantity;
+};
+} // namespace
+
+template<>
+struct hage::is_log_pod<Quote> : std::true_type
+{};
+
+template<>
+struct fmt::formatter<Quote> : fmt::formatter<std::string_view>
+{
+  template<typename FormatContext>
+  auto format(const Quote& quote, FormatContext& ctx) const
+  {
+    return fmt::format_to(ctx.out(), "{} {} {}@{}", quote.instrument, quote.side, quote.quantity, quote.price);
+  }
+};
+
+TEST_CASE_TEMPLATE("Log pods should be copied as their bytes", Buffer, hage::RingBuffer<4096>, hage::VectorBuffer)
+{
+  static_assert(hage::BitwiseSerializable<Quote>);
+  static_assert(hage::encoded_size(Quote{}) == sizeof(Quote));
+  static_assert(std::is_same_v<hage::SmartSerializer<const Quote&>::serialized_type, Quote>);
+
+  hage::test::TestSink sink;
+  Buffer buffer;
+  hage::Logger logger(&buffer, &sink);
+
+  const Quote quote{ 7, 'B', 101.25, 300 };
+  const std::vector<Quote> book{ quote, { 7, 'S', 101.5, 200 } };
+  logger.info("{}", quote);
+  logger.info("{} {}"_fmt, 'c', book);
+
+  REQUIRE_EQ(logger.drain(), 2);
+  sink.require_info("7 B 300@101.25");
+  sink.require_info("c [7 B 300@101.25, 7 S 200@101.5]");
+  REQUIRE_UNARY(sink.empty());
+}
+
 TEST_CASE("RingBuffer")
 {
   constexpr std::size_t N = 10;
@@ -351,6 +504,205 @@ TEST_CASE("logger should fail on too big a message")
   REQUIRE_UNARY_FALSE(logger.try_error("{} {} {}"_fmt, power, power, power));
 }
 
+TEST_CASE("Logging a message that is too big should throw, without waiting for the consumer")
+{
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &sink, 500);
+
+  // There is a message for the consumer to read, so a message that could fit would wait for it.
+  logger.info("before");
+
+  std::string lel(600, 'l');
+  REQUIRE_THROWS(logger.error("{}", lel));
+  REQUIRE_THROWS(logger.error("{}"_fmt, lel));
+  REQUIRE_EQ(logger.dropped(hage::LogLevel::Error), 0);
+
+  REQUIRE_EQ(logger.drain(), 1);
+  sink.require_info("before");
+  REQUIRE_UNARY(sink.empty());
+}
+
+TEST_CASE("Lines that don't fit should be counted and reported")
+{
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &sink, 100);
+
+  SUBCASE("Logging with the drop policy shouldn't block")
+  {
+    logger.set_overflow_policy(hage::OverflowPolicy::DropNewest);
+    for (int i = 0; i < 1000; i++)
+      logger.info("line {}", i);
+    logger.warn("line {}", 1000);
+
+    const auto dropped = logger.dropped(hage::LogLevel::Info);
+    REQUIRE_GT(dropped, 0);
+    REQUIRE_EQ(logger.dropped(hage::LogLevel::Warn), 1);
+
+    const auto written = 1000 - dropped;
+    REQUIRE_EQ(logger.drain(), written);
+    for (std::uint64_t i = 0; i < written; i++)
+      sink.require_info(fmt::format("line {}", i));
+
+    logger.info("after");
+    REQUIRE_EQ(logger.drain(), 2);
+    sink.require_warn(fmt::format("{} log lines were dropped, as they didn't fit in the buffer: 0 trace, 0 debug, "
+                                  "{} info, 1 warn, 0 error, 0 critical",
+                                  dropped + 1,
+                                  dropped));
+    sink.require_info("after");
+    REQUIRE_UNARY(sink.empty());
+  }
+
+  SUBCASE("Failed tries should be counted")
+  {
+    std::size_t written = 0;
+    while (logger.try_error("line {}", written))
+      written++;
+    REQUIRE_EQ(logger.dropped(hage::LogLevel::Error), 1);
+
+    REQUIRE_EQ(logger.drain(), written);
+    for (std::size_t i = 0; i < written; i++)
+      sink.require_error(fmt::format("line {}", i));
+
+    REQUIRE_UNARY(logger.try_error("after"));
+    REQUIRE_EQ(logger.drain(), 2);
+    sink.require_warn("1 log lines were dropped, as they didn't fit in the buffer: 0 trace, 0 debug, 0 info, 0 warn, "
+                      "1 error, 0 critical");
+    sink.require_error("after");
+    REQUIRE_UNARY(sink.empty());
+  }
+}
+
+TEST_CASE("Logger stats")
+{
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &sink, 100);
+
+  const auto empty = logger.stats();
+  REQUIRE_EQ(empty.messagesWritten, 0);
+  REQUIRE_EQ(empty.occupancy, 0);
+  REQUIRE_EQ(empty.capacity, ringBuffer.capacity());
+
+  for (int i = 0; i < 10; i++)
+    logger.info("line {}", i);
+
+  const auto written = logger.stats();
+  REQUIRE_EQ(written.messagesWritten, 10);
+  REQUIRE_GT(written.bytesWritten, 0);
+  REQUIRE_EQ(written.occupancy, written.bytesWritten);
+  REQUIRE_EQ(written.messagesRead, 0);
+
+  // The peak is kept by the producer, so it is there before the consumer has looked.
+  REQUIRE_EQ(written.peakOccupancy, written.occupancy);
+
+  REQUIRE_EQ(logger.drain(), 10);
+
+  // Reading doesn't lower the peak.
+  const auto read = logger.stats();
+  REQUIRE_EQ(read.messagesRead, 10);
+  REQUIRE_EQ(read.bytesRead, written.bytesWritten);
+  REQUIRE_EQ(read.occupancy, 0);
+  REQUIRE_EQ(read.peakOccupancy, written.occupancy);
+  REQUIRE_EQ(read.producerWaits, 0);
+
+  SUBCASE("Producers waiting for room should be counted")
+  {
+    std::latch started(1);
+    std::jthread consumer([&logger, &started]() {
+      started.wait();
+      while (logger.stats().messagesRead < 1010)
+        logger.try_read_logs(10);
+    });
+
+    started.count_down();
+    for (int i = 0; i < 1000; i++)
+      logger.info("line {}", i);
+    consumer.join();
+
+    const auto stats = logger.stats();
+    REQUIRE_EQ(stats.messagesWritten, 1010);
+    REQUIRE_LE(stats.peakOccupancy, stats.capacity);
+    REQUIRE_GT(stats.sinkTime.count(), 0);
+  }
+}
+
+TEST_CASE("A parked producer and consumer should always be woken")
+{
+  hage::test::TestSink sink;
+  hage::RingBuffer<512> ringBuffer;
+  hage::Logger logger(&ringBuffer, &sink, 100);
+
+  // The buffer only fits a few lines, and the consumer reads one at a time, so both sides keep parking.
+  constexpr std::size_t lines = 20000;
+  std::jthread consumer([&logger]() {
+    for (std::size_t read = 0; read < lines;)
+      read += logger.read_logs(1);
+  });
+
+  for (std::size_t i = 0; i < lines; i++)
+    logger.info("line {}", i);
+  consumer.join();
+
+  for (std::size_t i = 0; i < lines; i++)
+    sink.require_info(fmt::format("line {}", i));
+  REQUIRE_UNARY(sink.empty());
+}
+
+TEST_CASE("Messages should be sized before they are written")
+{
+  static_assert(hage::encoded_size(std::int32_t{ 5 }) == 4);
+  static_assert(hage::encoded_size(std::string_view("hello")) == sizeof(std::size_t) + 5);
+  static_assert(hage::SizedSerializer<const char(&)[6]>);
+
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &sink, 100);
+
+  // The site, the timestamp, the format string and its size take up 32 bytes, and the string its size and contents.
+  const std::string fits(100 - 32 - sizeof(std::size_t), 'a');
+  const std::string tooBig(fits.size() + 1, 'a');
+
+  REQUIRE_UNARY_FALSE(logger.try_info("{}", tooBig));
+  REQUIRE_EQ(logger.stats().bytesWritten, 0);
+
+  // The message that didn't fit is reported first.
+  REQUIRE_UNARY(logger.try_info("{}", fits));
+  REQUIRE_EQ(logger.drain(), 2);
+  sink.require_warn("1 log lines were dropped, as they didn't fit in the buffer: 0 trace, 0 debug, 1 info, 0 warn, "
+                    "0 error, 0 critical");
+  sink.require_info(fits);
+}
+
+TEST_CASE("format strings should not be copied into the buffer")
+{
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &sink, 100);
+
+  // Only a pointer to the format string goes through the buffer, so it can be far larger than a message.
+  constexpr std::string_view longLine =
+    "This is a very long format string, it just keeps going and going, far past the max message size of the logger, "
+    "which only has room for the static site, the timestamp and the arguments. The number is: {}";
+
+  REQUIRE_UNARY(logger.try_warn("This is a very long format string, it just keeps going and going, far past the max "
+                                "message size of the logger, which only has room for the static site, the timestamp "
+                                "and the arguments. The number is: {}",
+                                10));
+  REQUIRE_UNARY(logger.try_read_log());
+  sink.require_warn(fmt::format(fmt::runtime(longLine), 10));
+
+  logger.log(hage::LogLevel::Error, "{} and {}"_fmt, 1, 2);
+  logger.log(hage::LogLevel::Trace, "{} and {}"_fmt, 3, 4);
+  logger.log(hage::LogLevel::Critical, "{} and {}", 5, 6);
+  REQUIRE_EQ(logger.drain(), 2);
+  sink.require_error("1 and 2");
+  sink.require_critical("5 and 6");
+  REQUIRE_UNARY(sink.empty());
+}
+
 TEST_CASE("allow logger to set max message size")
 {
   hage::NullSink sink;
@@ -370,6 +722,40 @@ TEST_CASE("allow logger to set max message size")
   REQUIRE_UNARY(logger.try_read_log());
 }
 
+TEST_CASE_TEMPLATE("Logger should work with both static and virtual buffers",
+                   LoggerType,
+                   hage::Logger<hage::RingBuffer<4096>>,
+                   hage::Logger<hage::ByteBuffer>,
+                   hage::Logger<hage::VectorBuffer>)
+{
+  static_assert(hage::StaticByteBuffer<hage::RingBuffer<4096>>);
+  static_assert(hage::StaticByteBuffer<hage::VectorBuffer>);
+  static_assert(!hage::StaticByteBuffer<hage::ByteBuffer>);
+
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::VectorBuffer vectorBuffer;
+
+  auto* buffer = [&]() {
+    if constexpr (std::is_same_v<LoggerType, hage::Logger<hage::VectorBuffer>>)
+      return &vectorBuffer;
+    else
+      return &ringBuffer;
+  }();
+
+  LoggerType logger(buffer, &sink);
+
+  REQUIRE_UNARY(logger.try_info("runtime {} {}", 10, "Fun"));
+  REQUIRE_UNARY(logger.try_info("compile time {} {}"_fmt, 20, "Fan"));
+  REQUIRE_UNARY(logger.try_read_log());
+  REQUIRE_UNARY(logger.try_read_log());
+  REQUIRE_UNARY_FALSE(logger.try_read_log());
+
+  sink.require_info("runtime 10 Fun");
+  sink.require_info("compile time 20 Fan");
+  REQUIRE_UNARY(sink.empty());
+}
+
 TEST_CASE("test async interface")
 {
   hage::test::TestSink sink;
@@ -462,6 +848,53 @@ TEST_CASE("test async interface")
   }
 }
 
+TEST_CASE_TEMPLATE("Batch reading",
+                   LoggerType,
+                   hage::Logger<hage::RingBuffer<4096>>,
+                   hage::Logger<hage::ByteBuffer>)
+{
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  LoggerType logger(&ringBuffer, &sink, 100);
+
+  REQUIRE_EQ(logger.try_read_logs(10), 0);
+  REQUIRE_EQ(logger.drain(), 0);
+
+  for (int i = 0; i < 10; i++)
+    REQUIRE_UNARY(logger.try_info("line {}", i));
+
+  SUBCASE("try_read_logs should stop at the max number of records")
+  {
+    REQUIRE_EQ(logger.try_read_logs(4), 4);
+    REQUIRE_EQ(sink.size(), 4);
+    REQUIRE_EQ(logger.try_read_logs(100), 6);
+    REQUIRE_EQ(logger.try_read_logs(100), 0);
+  }
+
+  SUBCASE("drain should read everything")
+  {
+    REQUIRE_EQ(logger.drain(), 10);
+    REQUIRE_UNARY_FALSE(logger.try_read_log());
+  }
+
+  SUBCASE("read_logs should not wait when there are logs")
+  {
+    REQUIRE_EQ(logger.read_logs(3), 3);
+    REQUIRE_EQ(logger.read_logs(100), 7);
+  }
+
+  for (int i = 0; i < 10; i++)
+    sink.require_info(fmt::format("line {}", i));
+
+  REQUIRE_UNARY(sink.empty());
+
+  // All the space should have been handed back.
+  for (int i = 0; i < 1000; i++) {
+    REQUIRE_UNARY(logger.try_info("line {}", i));
+    REQUIRE_EQ(logger.drain(), 1);
+  }
+}
+
 TEST_CASE("Test syncronized interface")
 {
   hage::test::TestSink sink;
@@ -589,6 +1022,166 @@ TEST_CASE("FilterSink")
   REQUIRE_UNARY(testSink.empty());
 }
 
+TEST_CASE("Sinks should receive whole batches")
+{
+  hage::test::TestSink testSink;
+  hage::RingBuffer<4096> ringBuffer;
+
+  SUBCASE("The logger should pass everything it read at once")
+  {
+    hage::Logger logger(&ringBuffer, &testSink);
+    for (int i = 0; i < 5; i++)
+      logger.info("line {}", i);
+
+    REQUIRE_EQ(logger.drain(), 5);
+    REQUIRE_EQ(testSink.batches(), std::vector<std::size_t>{ 5 });
+    for (int i = 0; i < 5; i++)
+      testSink.require_info(fmt::format("line {}", i));
+  }
+
+  SUBCASE("FilterSink should pass on the runs that make it through")
+  {
+    hage::FilterSink filterSink(&testSink, hage::LogLevel::Warn);
+    hage::Logger logger(&ringBuffer, &filterSink);
+
+    logger.warn("1");
+    logger.error("2");
+    logger.info("3");
+    logger.critical("4");
+
+    REQUIRE_EQ(logger.drain(), 4);
+    REQUIRE_EQ(testSink.batches(), (std::vector<std::size_t>{ 2, 1 }));
+    testSink.require_warn("1");
+    testSink.require_error("2");
+    testSink.require_critical("4");
+    REQUIRE_UNARY(testSink.empty());
+  }
+
+  SUBCASE("MultiSink should pass the batch to each sink once")
+  {
+    hage::test::TestSink otherSink;
+    hage::MultiSink multiSink{ &testSink, &otherSink };
+    hage::Logger logger(&ringBuffer, &multiSink);
+
+    logger.info("1");
+    logger.info("2");
+
+    REQUIRE_EQ(logger.drain(), 2);
+    REQUIRE_EQ(testSink.batches(), std::vector<std::size_t>{ 2 });
+    REQUIRE_EQ(otherSink.batches(), std::vector<std::size_t>{ 2 });
+    otherSink.require_info("1");
+    otherSink.require_info("2");
+  }
+}
+
+TEST_CASE("Timestamp cache")
+{
+  using namespace std::chrono_literals;
+
+  const hage::Sink::timestamp_type second = std::chrono::sys_days{ std::chrono::year{ 2024 } / 4 / 5 } + 10h;
+  const auto ts = second + 123456789ns;
+
+  hage::TimestampCache cache;
+  fmt::memory_buffer out;
+  const auto format = [&cache, &out](const hage::Sink::timestamp_type& time) {
+    out.clear();
+    cache.append(out, time);
+    return std::string(out.data(), out.size());
+  };
+
+  SUBCASE("Should write the requested precision")
+  {
+    cache.set_precision(hage::TimestampPrecision::Seconds);
+    REQUIRE_EQ(format(ts), "2024-04-05 10:00:00 +0000");
+    cache.set_precision(hage::TimestampPrecision::Milliseconds);
+    REQUIRE_EQ(format(ts), "2024-04-05 10:00:00.123 +0000");
+    cache.set_precision(hage::TimestampPrecision::Microseconds);
+    REQUIRE_EQ(format(ts), "2024-04-05 10:00:00.123456 +0000");
+  }
+
+  SUBCASE("Should move on to the next second")
+  {
+    cache.set_precision(hage::TimestampPrecision::Milliseconds);
+    REQUIRE_EQ(format(second + 999ms), "2024-04-05 10:00:00.999 +0000");
+    REQUIRE_EQ(format(second + 1s), "2024-04-05 10:00:01.000 +0000");
+    REQUIRE_EQ(format(second - 1ms), "2024-04-05 09:59:59.999 +0000");
+  }
+
+  SUBCASE("Should handle times before the epoch")
+  {
+    cache.set_precision(hage::TimestampPrecision::Milliseconds);
+    REQUIRE_EQ(format(hage::Sink::timestamp_type{} - 1ms), "1969-12-31 23:59:59.999 +0000");
+  }
+}
+
+TEST_CASE("Line pattern")
+{
+  using namespace std::chrono_literals;
+
+  const hage::Sink::timestamp_type ts = std::chrono::sys_days{ std::chrono::year{ 2024 } / 4 / 5 } + 10h + 5ms;
+  const hage::Sink::Record record{ hage::LogLevel::Warn, ts, "Hello", std::source_location::current(), 7 };
+
+  fmt::memory_buffer out;
+  const auto format = [&out, &record](hage::LinePattern& pattern) {
+    out.clear();
+    pattern.format(out, record);
+    return std::string(out.data(), out.size());
+  };
+
+  SUBCASE("The default pattern should match the old layout")
+  {
+    hage::LinePattern pattern;
+    pattern.set_timestamp_precision(hage::TimestampPrecision::Milliseconds);
+    REQUIRE_EQ(format(pattern), "[2024-04-05 10:00:00.005 +0000] [WARN ]: Hello\n");
+  }
+
+  SUBCASE("Should write each field")
+  {
+    hage::LinePattern pattern("{time:s} {level}|{thread}|{line}|{message}");
+    REQUIRE_EQ(format(pattern), fmt::format("2024-04-05 10:00:00 +0000 WARN |7|{}|Hello", record.location.line()));
+
+    hage::LinePattern callsite("{file}:{function}");
+    REQUIRE_EQ(format(callsite),
+               fmt::format("{}:{}", record.location.file_name(), record.location.function_name()));
+  }
+
+  SUBCASE("Should write escaped braces")
+  {
+    hage::LinePattern pattern("{{{message}}} }}{{");
+    REQUIRE_EQ(format(pattern), "{Hello} }{");
+  }
+
+  SUBCASE("Should reject bad patterns")
+  {
+    REQUIRE_THROWS_AS(hage::LinePattern("{nope}"), std::runtime_error);
+    REQUIRE_THROWS_AS(hage::LinePattern("{message"), std::runtime_error);
+    REQUIRE_THROWS_AS(hage::LinePattern("message}"), std::runtime_error);
+    REQUIRE_THROWS_AS(hage::LinePattern("{time:h}"), std::runtime_error);
+    REQUIRE_THROWS_AS(hage::LinePattern("{level:5}"), std::runtime_error);
+  }
+
+  SUBCASE("Loggers should pass on the thread they log from")
+  {
+    hage::test::ScopedTempFile tempFile("line_pattern_test.{}.txt");
+    {
+      hage::FileSink fs(tempFile.path);
+      fs.set_pattern(hage::LinePattern("{thread} {message}\n"));
+      hage::RingBuffer<4096> ringBuffer;
+      hage::Logger logger(&ringBuffer, &fs);
+
+      logger.info("first");
+      REQUIRE_EQ(logger.drain(), 1);
+      logger.set_thread_id(42);
+      logger.info("second");
+      REQUIRE_EQ(logger.drain(), 1);
+    }
+
+    std::ifstream file(tempFile.path);
+    const std::string contents{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    REQUIRE_EQ(contents, fmt::format("{} first\n42 second\n", hage::this_thread_log_id()));
+  }
+}
+
 TEST_CASE("File sink")
 {
   const hage::test::ScopedTempFile tempFile("file_sink_test.{}.txt");
@@ -606,6 +1199,152 @@ TEST_CASE("File sink")
   REQUIRE_LE(fs.bytes_written(), 64);
 }
 
+TEST_CASE("File sink flush policy")
+{
+  const hage::test::ScopedTempFile tempFile("file_sink_test.{}.txt");
+
+  hage::FileSink fs(tempFile.path, hage::FileFlushPolicy{ .bufferSize = 4096, .maxDelay = std::chrono::hours(1) });
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &fs);
+
+  logger.info("Hello there!: {}", 10);
+  logger.read_log();
+
+  // The line is kept in the buffer, but still counted.
+  REQUIRE_GT(fs.bytes_written(), 0);
+  REQUIRE_EQ(std::filesystem::file_size(tempFile.path), 0);
+
+  SUBCASE("Errors should be written straight away")
+  {
+    logger.error("Oh no");
+    logger.read_log();
+    REQUIRE_EQ(std::filesystem::file_size(tempFile.path), fs.bytes_written());
+  }
+
+  SUBCASE("Filling the buffer should write it")
+  {
+    while (std::filesystem::file_size(tempFile.path) == 0 && fs.bytes_written() <= 4096) {
+      logger.info("Hello there!: {}", 10);
+      logger.read_log();
+    }
+    REQUIRE_EQ(std::filesystem::file_size(tempFile.path), fs.bytes_written());
+  }
+
+  SUBCASE("Flush should write the buffer")
+  {
+    fs.flush();
+    REQUIRE_EQ(std::filesystem::file_size(tempFile.path), fs.bytes_written());
+  }
+
+  SUBCASE("An idle consumer should write lines older than the max delay")
+  {
+    const auto now = std::chrono::system_clock::now();
+    logger.on_idle(now);
+    REQUIRE_EQ(std::filesystem::file_size(tempFile.path), 0);
+
+    logger.on_idle(now + std::chrono::hours(1));
+    REQUIRE_EQ(std::filesystem::file_size(tempFile.path), fs.bytes_written());
+  }
+}
+
+TEST_CASE("Async file sink")
+{
+  const hage::test::ScopedTempFile tempFile("async_file_sink_test.{}.txt");
+
+  bool useIoUring = true;
+  SUBCASE("With io_uring, where available")
+  {
+    useIoUring = true;
+  }
+  SUBCASE("With the helper thread")
+  {
+    useIoUring = false;
+  }
+
+  constexpr int lines = 100;
+  {
+    hage::AsyncFileSink fs(tempFile.path,
+                           { .policy = { .bufferSize = 256, .maxDelay = std::chrono::hours(1) },
+                             .bufferCount = 2,
+                             .useIoUring = useIoUring });
+    if (!useIoUring)
+      REQUIRE_UNARY_FALSE(fs.uses_io_uring());
+
+    hage::RingBuffer<4096> ringBuffer;
+    hage::Logger logger(&ringBuffer, &fs);
+
+    for (int i = 0; i < lines; i++) {
+      logger.info("Line number {}", i);
+      logger.read_log();
+    }
+    fs.flush();
+
+    const auto stats = fs.stats();
+    REQUIRE_EQ(stats.inFlight, 0);
+    REQUIRE_GT(stats.writesCompleted, 1);
+    REQUIRE_LE(stats.totalWriteLatency, stats.maxWriteLatency * stats.writesCompleted);
+    REQUIRE_EQ(std::filesystem::file_size(tempFile.path), fs.bytes_written());
+  }
+
+  // The buffers should have been written in order.
+  std::ifstream in(tempFile.path);
+  std::string line;
+  int read = 0;
+  while (std::getline(in, line)) {
+    REQUIRE_UNARY(line.ends_with(fmt::format("Line number {}", read)));
+    read++;
+  }
+  REQUIRE_EQ(read, lines);
+}
+
+TEST_CASE("Async file sink should hand back buffers whose write failed")
+{
+  const hage::test::ScopedTempFile tempFile("async_file_sink_test.{}.txt");
+  std::ofstream(tempFile.path) << "";
+
+  bool useIoUring = true;
+  SUBCASE("With io_uring, where available")
+  {
+    useIoUring = true;
+  }
+  SUBCASE("With the helper thread")
+  {
+    useIoUring = false;
+  }
+
+  // Writes to a file opened for reading fail.
+  hage::AsyncFileSink fs(tempFile.path,
+                         { .policy = { .bufferSize = 64, .maxDelay = std::chrono::hours(1) },
+                           .bufferCount = 2,
+                           .useIoUring = useIoUring },
+                         fmt::file::RDONLY);
+
+  const auto fill = [&fs]() {
+    for (int i = 0; i < 4; i++)
+      fs.receive(hage::LogLevel::Info, {}, "a line that is long enough to fill a buffer by itself");
+  };
+
+  // The failures have to come out somewhere, and once they have, nothing should still be waiting on the disk.
+  for (int round = 0; round < 2; round++) {
+    bool failed = false;
+    try {
+      fill();
+    } catch (const std::system_error&) {
+      failed = true;
+    }
+    while (true) {
+      try {
+        fs.flush();
+        break;
+      } catch (const std::system_error&) {
+        failed = true;
+      }
+    }
+    REQUIRE_UNARY(failed);
+    REQUIRE_EQ(fs.stats().inFlight, 0);
+  }
+}
+
 TEST_CASE("testing syncronized logger")
 {
   using namespace hage::literals;
@@ -688,6 +1427,37 @@ TEST_CASE("testing syncronized logger, compile_time passing")
   REQUIRE_UNARY(testSink.empty());
 }
 
+TEST_CASE("testing syncronized logger, batch reading")
+{
+  hage::test::TestSink testSink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &testSink);
+  std::latch ready(2);
+
+  constexpr std::size_t TIMES = 10000;
+
+  std::thread writer([&logger, &ready]() {
+    ready.arrive_and_wait();
+    for (std::size_t i = 0; i < TIMES; i++)
+      logger.info("Here we are: {} and my name is: {}", i, "hermes");
+  });
+
+  std::thread reader([&logger, &ready]() {
+    ready.arrive_and_wait();
+    std::size_t i = 0;
+    while (i < TIMES)
+      i += logger.read_logs(64);
+  });
+
+  writer.join();
+  reader.join();
+
+  for (std::size_t i = 0; i < TIMES; i++)
+    testSink.require_info(fmt::format("Here we are: {} and my name is: hermes", i));
+
+  REQUIRE_UNARY(testSink.empty());
+}
+
 TEST_CASE("Testing timeout reading")
 {
   using namespace hage::literals;
@@ -701,4 +1471,229 @@ TEST_CASE("Testing timeout reading")
   logger.info("Warning!");
 }
 
+TEST_CASE_TEMPLATE("Timestamps are taken by the producer",
+                   ClockType,
+                   hage::SystemClock,
+                   hage::CoarseClock,
+                   hage::TscClock)
+{
+  using namespace std::chrono_literals;
+
+  hage::test::TestSink sink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger<hage::RingBuffer<4096>, ClockType> logger(&ringBuffer, &sink);
+
+  // The coarse clock is only updated on each kernel tick.
+  constexpr auto slack = 20ms;
+
+  const auto before = std::chrono::system_clock::now();
+  logger.info("Hello there");
+  const auto after = std::chrono::system_clock::now();
+
+  std::this_thread::sleep_for(100ms);
+  REQUIRE_UNARY(logger.try_read_log());
+
+  const auto ts = sink.front_timestamp();
+  REQUIRE_LE(before - slack, ts);
+  REQUIRE_LE(ts, after + slack);
+  sink.require_info("Hello there");
+}
+
+TEST_CASE("Multi producer logger")
+{
+  hage::test::TestSink testSink;
+  hage::MultiProducerLogger<hage::RingBuffer<4096>> logger(&testSink);
+
+  SUBCASE("A single producer should work like a normal logger")
+  {
+    REQUIRE_EQ(logger.producers(), 0);
+    logger.info("Here we are: {} and my name is: {}", 1, "hermes");
+    REQUIRE_UNARY(logger.try_warn("Here we are: {} and my name is: {}", 2, "hermes"));
+    logger.debug("This is filtered");
+    REQUIRE_EQ(logger.producers(), 1);
+
+    REQUIRE_EQ(logger.drain(), 2);
+    testSink.require_info("Here we are: 1 and my name is: hermes");
+    testSink.require_warn("Here we are: 2 and my name is: hermes");
+    REQUIRE_UNARY(testSink.empty());
+
+    logger.set_min_log_level(hage::LogLevel::Debug);
+    logger.debug("Not anymore");
+    REQUIRE_EQ(logger.drain(), 1);
+    testSink.require_debug("Not anymore");
+  }
+
+  SUBCASE("Threads should get their own buffers, which are freed when they exit")
+  {
+    constexpr std::size_t THREADS = 4;
+    constexpr std::size_t TIMES = 5000;
+
+    std::latch ready(THREADS + 1);
+    std::vector<std::thread> writers;
+    for (std::size_t t = 0; t < THREADS; t++) {
+      writers.emplace_back([&logger, &ready, t]() {
+        ready.arrive_and_wait();
+        for (std::size_t i = 0; i < TIMES; i++)
+          logger.info("{} {}", t, i);
+      });
+    }
+
+    ready.arrive_and_wait();
+    std::size_t records = 0;
+    while (records < THREADS * TIMES)
+      records += logger.try_read_logs(64);
+
+    for (auto& writer : writers)
+      writer.join();
+
+    // The exited threads are cleaned up on the next poll.
+    REQUIRE_EQ(logger.drain(), 0);
+    REQUIRE_EQ(logger.producers(), 0);
+
+    // The lines from each thread should be in order.
+    std::array<std::size_t, THREADS> next{};
+    for (std::size_t i = 0; i < THREADS * TIMES; i++) {
+      REQUIRE_UNARY_FALSE(testSink.empty());
+      std::size_t t = 0;
+      for (; t < THREADS; t++) {
+        if (next[t] < TIMES && testSink.front_is(hage::LogLevel::Info, fmt::format("{} {}", t, next[t])))
+          break;
+      }
+      REQUIRE_LT(t, THREADS);
+      testSink.require_info(fmt::format("{} {}", t, next[t]++));
+    }
+    REQUIRE_UNARY(testSink.empty());
+  }
+}
+
+TEST_CASE("LogWorker")
+{
+  hage::test::TestSink testSink;
+  hage::RingBuffer<4096> ringBuffer;
+  hage::Logger logger(&ringBuffer, &testSink);
+
+  constexpr std::size_t TIMES = 10000;
+
+  SUBCASE("It should read everything before it stops")
+  {
+    hage::LogWorker worker;
+    worker.add(logger);
+
+    for (std::size_t i = 0; i < TIMES; i++)
+      logger.info("Here we are: {} and my name is: {}", i, "hermes");
+
+    worker.stop();
+    for (std::size_t i = 0; i < TIMES; i++)
+      testSink.require_info(fmt::format("Here we are: {} and my name is: hermes", i));
+    REQUIRE_UNARY(testSink.empty());
+  }
+
+  SUBCASE("Producers should wake it up when it has parked")
+  {
+    // The worker parks as soon as it finds nothing, and the producer blocks when the buffer is full. So if a wakeup is
+    // lost, this never finishes.
+    hage::LogWorker worker(hage::LogWorker::IdlePolicy{ .spins = 0, .yields = 0 }, 1);
+    worker.add(logger);
+
+    for (std::size_t i = 0; i < TIMES; i++) {
+      logger.info("Here we are: {} and my name is: {}", i, "hermes");
+      if (i % 1000 == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    worker.stop();
+    REQUIRE_EQ(testSink.size(), TIMES);
+  }
+
+  SUBCASE("It should serve many loggers")
+  {
+    hage::test::TestSink multiSink;
+    hage::MultiProducerLogger<hage::RingBuffer<4096>> multiLogger(&multiSink);
+
+    hage::LogWorker worker(hage::LogWorker::IdlePolicy{ .spins = 10, .yields = 10 });
+    worker.add(logger);
+    worker.add(multiLogger);
+
+    std::thread other([&multiLogger]() {
+      for (std::size_t i = 0; i < TIMES; i++)
+        multiLogger.info("{}", i);
+    });
+
+    for (std::size_t i = 0; i < TIMES; i++)
+      logger.info("{}", i);
+
+    other.join();
+    worker.stop();
+
+    for (std::size_t i = 0; i < TIMES; i++) {
+      testSink.require_info(fmt::format("{}", i));
+      multiSink.require_info(fmt::format("{}", i));
+    }
+  }
+
+  SUBCASE("It should let the sinks write out lines while it is parked")
+  {
+    const hage::test::ScopedTempFile tempFile("log_worker_test.{}.txt");
+    hage::FileSink fs(tempFile.path, hage::FileFlushPolicy{ .maxDelay = std::chrono::milliseconds(10) });
+    hage::RingBuffer<4096> fileBuffer;
+    hage::Logger fileLogger(&fileBuffer, &fs);
+
+    hage::LogWorker worker(
+      hage::LogWorker::IdlePolicy{ .spins = 0, .yields = 0, .idleInterval = std::chrono::milliseconds(1) });
+    worker.add(fileLogger);
+
+    // Nothing else is logged, so only the worker being idle can get the line written.
+    fileLogger.info("Waiting for the max delay");
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::filesystem::file_size(tempFile.path) == 0 && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    REQUIRE_GT(std::filesystem::file_size(tempFile.path), 0);
+    worker.stop();
+  }
+
+  SUBCASE("It should go back to parking after looking at the sinks")
+  {
+    // The yields take far longer than the idle interval, so the sinks are only told often enough if a timeout goes
+    // straight back to parking.
+    hage::LogWorker worker(hage::LogWorker::IdlePolicy{
+      .spins = 0, .yields = 1'000'000, .idleInterval = std::chrono::milliseconds(1) });
+    worker.add(logger);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (testSink.idle_calls() == 0 && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    const auto before = testSink.idle_calls();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE_GE(testSink.idle_calls() - before, 10);
+    worker.stop();
+  }
+
+  SUBCASE("A removed logger should be left alone")
+  {
+    hage::LogWorker worker;
+    worker.add(logger);
+    worker.remove(logger);
+
+    logger.info("Not read by the worker");
+    worker.stop();
+    REQUIRE_UNARY(testSink.empty());
+    REQUIRE_UNARY(logger.try_read_log());
+    testSink.require_info("Not read by the worker");
+  }
+
+  SUBCASE("A logger should outlive the worker")
+  {
+    auto worker = std::make_unique<hage::LogWorker>();
+    worker->add(logger);
+    worker.reset();
+
+    // The logger must not try to wake the worker that is gone.
+    logger.info("After the worker");
+    REQUIRE_UNARY(logger.try_read_log());
+    testSink.require_info("After the worker");
+  }
+}
+
 TEST_SUITE_END();
\ No newline at end of file
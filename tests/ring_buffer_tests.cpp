@@ -1,4 +1,257 @@
-//
-// Created by rhermes on 4/7/24.
-//
+#include <latch>
+#include <thread>
+#include <vector>
+
+#include <hage/core/misc.hpp>
+#include <hage/logging/logger.hpp>
+#include <hage/logging/mirrored_ring_buffer.hpp>
+#include <hage/logging/ring_buffer.hpp>
+
 #include <doctest/doctest.h>
+
+#include "test_sink.hpp"
+
+TEST_SUITE_BEGIN("logging");
+
+namespace {
+template<typename Writer>
+bool
+write_record(Writer& writer, const std::span<const std::byte> src)
+{
+  const auto dst = writer.reserve(src.size());
+  if (dst.size() != src.size())
+    return false;
+
+  std::ranges::copy(src, dst.begin());
+  return writer.commit(src.size());
+}
+} // namespace
+
+TEST_CASE("RingBuffer records")
+{
+  static_assert(hage::ReservableByteBuffer<hage::RingBuffer<10>>);
+
+  constexpr std::size_t N = 20;
+  hage::RingBuffer<N> buffer;
+
+  SUBCASE("A buffer should start without records")
+  {
+    auto reader = buffer.reader();
+    REQUIRE_UNARY(reader.read_record().empty());
+  }
+
+  SUBCASE("Reservations are not visible before they are committed")
+  {
+    auto writer = buffer.writer();
+    auto reader = buffer.reader();
+
+    const auto dst = writer.reserve(3);
+    REQUIRE_EQ(dst.size(), 3);
+    REQUIRE_UNARY(reader.read_record().empty());
+
+    REQUIRE_UNARY(writer.commit(2));
+    const auto record = reader.read_record();
+    REQUIRE_EQ(record.size(), 2);
+    REQUIRE_EQ(record.data(), dst.data());
+    REQUIRE_UNARY(reader.read_record().empty());
+  }
+
+  SUBCASE("Committing more than was reserved should fail")
+  {
+    auto writer = buffer.writer();
+    REQUIRE_EQ(writer.reserve(3).size(), 3);
+    REQUIRE_UNARY_FALSE(writer.commit(4));
+    REQUIRE_UNARY_FALSE(writer.commit(0));
+  }
+
+  SUBCASE("Reservations larger than the buffer should fail")
+  {
+    auto writer = buffer.writer();
+    REQUIRE_UNARY(writer.reserve(N).empty());
+    REQUIRE_UNARY(writer.reserve(0).empty());
+  }
+
+  SUBCASE("A full buffer should refuse reservations until the reader commits")
+  {
+    auto writer = buffer.writer();
+    auto reader = buffer.reader();
+
+    constexpr auto in = hage::byte_array(1, 2, 3, 4, 5, 6);
+    static_assert(in.size() == hage::RingBuffer<N>::max_reservation());
+
+    REQUIRE_UNARY(write_record(writer, in));
+    REQUIRE_UNARY(write_record(writer, in));
+    REQUIRE_UNARY(writer.reserve(in.size()).empty());
+
+    REQUIRE_UNARY(std::ranges::equal(reader.read_record(), in));
+    REQUIRE_UNARY(std::ranges::equal(reader.read_record(), in));
+    REQUIRE_UNARY(writer.reserve(in.size()).empty());
+    REQUIRE_UNARY(reader.commit());
+    REQUIRE_UNARY(write_record(writer, in));
+  }
+
+  SUBCASE("Records should be contiguous at every position in the buffer")
+  {
+    auto writer = buffer.writer();
+    auto reader = buffer.reader();
+
+    std::array<std::byte, hage::RingBuffer<N>::max_reservation()> in{};
+    for (std::size_t i = 0; i < in.size(); i++)
+      in[i] = static_cast<std::byte>(i + 1);
+
+    for (std::size_t i = 0; i < 3 * (N + 1); i++) {
+      REQUIRE_UNARY(write_record(writer, in));
+
+      const auto record = reader.read_record();
+      REQUIRE_UNARY(std::ranges::equal(record, in));
+      REQUIRE_UNARY(reader.commit());
+      REQUIRE_EQ(writer.bytes_written(), reader.bytes_read());
+
+      // Now we need to advance the position 1
+      constexpr auto off = hage::byte_array(42);
+      REQUIRE_UNARY(write_record(writer, off));
+      REQUIRE_UNARY(std::ranges::equal(reader.read_record(), off));
+      REQUIRE_UNARY(reader.commit());
+      REQUIRE_EQ(writer.bytes_written(), reader.bytes_read());
+    }
+  }
+
+  SUBCASE("Reader and writer threads should work")
+  {
+    std::latch ready(2);
+
+    constexpr std::size_t TIMES = 10000;
+
+    std::thread writerThread([&buffer, &ready]() {
+      ready.arrive_and_wait();
+      auto writer = buffer.writer();
+      std::size_t i = 0;
+      while (i < TIMES) {
+        const auto in = hage::byte_array(i, i + 1, i + 2, i + 3, i + 4);
+        if (!write_record(writer, std::span(in).first(1 + i % in.size())))
+          continue;
+
+        i++;
+      }
+    });
+
+    std::thread readerThread([&buffer, &ready]() {
+      ready.arrive_and_wait();
+      auto reader = buffer.reader();
+      std::size_t i = 0;
+      while (i < TIMES) {
+        const auto record = reader.read_record();
+        if (record.empty())
+          continue;
+
+        const auto expected = hage::byte_array(i, i + 1, i + 2, i + 3, i + 4);
+        REQUIRE_UNARY(std::ranges::equal(record, std::span(expected).first(1 + i % expected.size())));
+        REQUIRE_UNARY(reader.commit());
+        i++;
+      }
+    });
+
+    writerThread.join();
+    readerThread.join();
+  }
+}
+
+#if HAGE_HAS_MIRRORED_RING_BUFFER
+TEST_CASE("MirroredRingBuffer")
+{
+  static_assert(hage::ReservableByteBuffer<hage::MirroredRingBuffer>);
+
+  hage::MirroredRingBuffer buffer(100);
+  const auto capacity = buffer.capacity();
+
+  SUBCASE("The capacity should be rounded up to whole pages")
+  {
+    REQUIRE_GE(capacity, 100);
+    REQUIRE_EQ(capacity % 4096, 0);
+    REQUIRE_EQ(buffer.max_reservation() + sizeof(std::uint32_t), capacity);
+  }
+
+  SUBCASE("Writes across the end of the buffer should be contiguous")
+  {
+    auto writer = buffer.writer();
+    auto reader = buffer.reader();
+
+    std::vector<std::byte> filler(capacity - 2);
+    REQUIRE_UNARY(writer.write(filler));
+    REQUIRE_UNARY(writer.commit());
+    REQUIRE_UNARY(reader.read(filler));
+    REQUIRE_UNARY(reader.commit());
+
+    constexpr auto in = hage::byte_array(1, 2, 3, 4, 5);
+    const auto dst = writer.reserve(in.size());
+    REQUIRE_EQ(dst.size(), in.size());
+    std::ranges::copy(in, dst.begin());
+    REQUIRE_UNARY(writer.commit(in.size()));
+
+    const auto record = reader.read_record();
+    REQUIRE_UNARY(std::ranges::equal(record, in));
+    REQUIRE_UNARY(reader.commit());
+    REQUIRE_EQ(writer.bytes_written(), reader.bytes_read());
+  }
+
+  SUBCASE("The whole capacity should be usable")
+  {
+    auto writer = buffer.writer();
+    auto reader = buffer.reader();
+
+    REQUIRE_EQ(writer.reserve(buffer.max_reservation()).size(), buffer.max_reservation());
+    REQUIRE_UNARY(writer.commit(buffer.max_reservation()));
+    REQUIRE_UNARY(writer.reserve(1).empty());
+
+    REQUIRE_EQ(reader.read_record().size(), buffer.max_reservation());
+    REQUIRE_UNARY(reader.commit());
+    REQUIRE_EQ(writer.reserve(buffer.max_reservation()).size(), buffer.max_reservation());
+  }
+
+  SUBCASE("Records should work at every position in the buffer")
+  {
+    auto writer = buffer.writer();
+    auto reader = buffer.reader();
+
+    constexpr auto in = hage::byte_array(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13);
+    for (std::size_t i = 0; i < 2 * capacity; i += in.size() + sizeof(std::uint32_t)) {
+      REQUIRE_UNARY(write_record(writer, in));
+      REQUIRE_UNARY(std::ranges::equal(reader.read_record(), in));
+      REQUIRE_UNARY(reader.commit());
+    }
+  }
+
+  SUBCASE("It should work as the buffer of a logger")
+  {
+    hage::test::TestSink sink;
+    hage::Logger logger(&buffer, &sink);
+    static_assert(std::is_same_v<decltype(logger), hage::Logger<hage::MirroredRingBuffer>>);
+
+    for (int i = 0; i < 1000; i++) {
+      REQUIRE_UNARY(logger.try_info("message {} {}", i, "here"));
+      REQUIRE_UNARY(logger.try_read_log());
+      sink.require_info(fmt::format("message {} here", i));
+    }
+  }
+}
+#endif
+
+TEST_CASE("SpanWriter and SpanReader")
+{
+  std::array<std::byte, 4> storage{};
+  hage::SpanWriter writer(storage);
+
+  REQUIRE_UNARY(writer.write(hage::byte_array(1, 2, 3)));
+  REQUIRE_UNARY_FALSE(writer.write(hage::byte_array(4, 5)));
+  REQUIRE_UNARY(writer.write(hage::byte_array(4)));
+  REQUIRE_EQ(writer.bytes_written(), 4);
+
+  hage::SpanReader reader(storage);
+  std::array<std::byte, 3> out{};
+  REQUIRE_UNARY(reader.read(out));
+  REQUIRE_EQ(out, hage::byte_array(1, 2, 3));
+  REQUIRE_UNARY_FALSE(reader.read(out));
+  REQUIRE_EQ(reader.bytes_read(), 3);
+}
+
+TEST_SUITE_END();
@@ -1,9 +1,19 @@
 #include <doctest/doctest.h>
 
 #include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <hage/logging/rotating_file_sink.hpp>
 
+#include "test_utils.hpp"
+
+#if defined(__linux__)
+#include <sys/stat.h>
+#endif
+
 TEST_SUITE_BEGIN("logging");
 
 TEST_CASE("SizeRotater")
@@ -48,4 +58,202 @@ TEST_CASE("SizeRotater")
   }
 }
 
-TEST_SUITE_END();
\ No newline at end of file
+TEST_CASE("TimeRotater")
+{
+  using namespace std::chrono_literals;
+
+  hage::TimeRotater rotater{ "test.{:%Y-%m-%d_%H}.log", std::chrono::hours(1) };
+  const hage::Sink::timestamp_type hour = std::chrono::sys_days{ std::chrono::year{ 2024 } / 4 / 5 } + 10h;
+  const auto at = [](const hage::Sink::timestamp_type ts) { return hage::LogFileStats{ .bytes = 10, .ts = ts }; };
+
+  REQUIRE_EQ(rotater.getRotateType(), hage::Rotater::Type::RemoveLast);
+
+  const auto first = rotater.generateNames(at(hour + 30min), 3);
+  REQUIRE_EQ(first.size(), 1);
+  REQUIRE_EQ(first[0], fmt::format("test.{:%Y-%m-%d_%H}.log", hour));
+
+  SUBCASE("Should rotate on the next hour")
+  {
+    REQUIRE_UNARY_FALSE(rotater.shouldRotate(at(hour + 59min)));
+    REQUIRE_UNARY(rotater.shouldRotate(at(hour + 60min)));
+  }
+
+  SUBCASE("Should remember the previous names, up to the limit")
+  {
+    REQUIRE_EQ(rotater.generateNames(at(hour + 1h), 3).size(), 2);
+    REQUIRE_EQ(rotater.generateNames(at(hour + 2h), 3).size(), 3);
+
+    const auto names = rotater.generateNames(at(hour + 3h), 3);
+    REQUIRE_EQ(names.size(), 3);
+    REQUIRE_EQ(names[0], fmt::format("test.{:%Y-%m-%d_%H}.log", hour + 3h));
+    REQUIRE_EQ(names[2], fmt::format("test.{:%Y-%m-%d_%H}.log", hour + 1h));
+  }
+}
+
+TEST_CASE("RotatingFileSink")
+{
+  const hage::test::ScopedTempDir dir("rotating_file_sink_test.{}");
+
+  // Every line is 45 bytes, so the files are rotated after every third line.
+  constexpr std::size_t maxSize = 100;
+  hage::RotatingFileSink::Config config{ .saveDirectory = dir.path,
+                                         .maxNumber = 3,
+                                         .preallocate = 64 * 1024,
+                                         .precision = hage::TimestampPrecision::Seconds };
+
+  std::size_t files = 0;
+  {
+    hage::RotatingFileSink sink(config, std::make_unique<hage::SizeRotater>("test.log", maxSize));
+    for (int i = 0; i < 20; i++)
+      sink.receive(hage::LogLevel::Info, {}, fmt::format("line {:02}", i));
+    sink.flush();
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir.path)) {
+      static_cast<void>(entry);
+      files++;
+    }
+  }
+
+  // The three files we keep, and the next one, waiting to be used.
+  REQUIRE_EQ(files, 4);
+  REQUIRE_UNARY(std::filesystem::exists(dir.path / "test.log"));
+  REQUIRE_UNARY(std::filesystem::exists(dir.path / "test.log.1"));
+  REQUIRE_UNARY(std::filesystem::exists(dir.path / "test.log.2"));
+  REQUIRE_UNARY_FALSE(std::filesystem::exists(dir.path / "test.log.3"));
+
+  const auto lines = [&dir](const std::string& name) {
+    std::vector<std::string> ans;
+    std::ifstream in(dir.path / name);
+    for (std::string line; std::getline(in, line);)
+      ans.push_back(line.substr(line.size() - 2));
+    return ans;
+  };
+
+  // The waiting file is removed along with the sink, and the space reserved in the others is given back.
+  REQUIRE_EQ(std::distance(std::filesystem::directory_iterator(dir.path), std::filesystem::directory_iterator()), 3);
+  REQUIRE_EQ(std::filesystem::file_size(dir.path / "test.log.1"), 3 * 45);
+#if defined(__linux__)
+  // The reserved space doesn't show in the size, only in the blocks the file takes up.
+  struct stat st
+  {};
+  REQUIRE_EQ(::stat((dir.path / "test.log.1").c_str(), &st), 0);
+  REQUIRE_LT(static_cast<std::size_t>(st.st_blocks) * 512, config.preallocate);
+#endif
+
+  REQUIRE_EQ(lines("test.log.2"), (std::vector<std::string>{ "12", "13", "14" }));
+  REQUIRE_EQ(lines("test.log.1"), (std::vector<std::string>{ "15", "16", "17" }));
+  REQUIRE_EQ(lines("test.log"), (std::vector<std::string>{ "18", "19" }));
+}
+
+TEST_CASE("RotatingFileSink should pass a batch on in runs between rotations")
+{
+  const hage::test::ScopedTempDir dir("rotating_file_sink_test.{}");
+
+  // Counts how often the sink asks if it should rotate.
+  class CountingRotater final : public hage::Rotater
+  {
+  public:
+    explicit CountingRotater(std::size_t& checks) : m_checks{ checks } {}
+
+    bool shouldRotate(const hage::LogFileStats& stats) override
+    {
+      m_checks++;
+      return m_inner.shouldRotate(stats);
+    }
+    hage::LogFileStats nextRotation() const override { return m_inner.nextRotation(); }
+    std::vector<std::filesystem::path> generateNames(const hage::LogFileStats& stats, const int times) override
+    {
+      return m_inner.generateNames(stats, times);
+    }
+    Type getRotateType() const override { return m_inner.getRotateType(); }
+
+  private:
+    hage::SizeRotater m_inner{ "test.log", 100 };
+    std::size_t& m_checks;
+  };
+
+  std::vector<std::string> lines;
+  std::vector<hage::Sink::Record> records;
+  for (int i = 0; i < 20; i++)
+    lines.push_back(fmt::format("line {:02}", i));
+  for (const auto& line : lines)
+    records.push_back(hage::Sink::Record{ hage::LogLevel::Info, {}, line });
+
+  // Every line is 45 bytes, so the files are rotated after every third line, as when they are passed one by one.
+  std::size_t checks = 0;
+  {
+    hage::RotatingFileSink sink({ .saveDirectory = dir.path,
+                                  .maxNumber = 3,
+                                  .precision = hage::TimestampPrecision::Seconds },
+                                std::make_unique<CountingRotater>(checks));
+    sink.receive_batch(records);
+    sink.flush();
+  }
+
+  // Once for each run, rather than once for each line.
+  REQUIRE_EQ(checks, 7);
+
+  const auto first_line = [&dir](const std::string& name) {
+    std::ifstream in(dir.path / name);
+    std::string line;
+    std::getline(in, line);
+    return line.substr(line.size() - 2);
+  };
+  REQUIRE_EQ(first_line("test.log.2"), "12");
+  REQUIRE_EQ(first_line("test.log.1"), "15");
+  REQUIRE_EQ(first_line("test.log"), "18");
+  REQUIRE_EQ(std::filesystem::file_size(dir.path / "test.log"), 2 * 45);
+}
+
+TEST_CASE("RotatingFileSink should keep rotating after the background thread fails")
+{
+  const hage::test::ScopedTempDir dir("rotating_file_sink_test.{}");
+
+  const hage::RotatingFileSink::Config config{ .saveDirectory = dir.path,
+                                               .maxNumber = 3,
+                                               .precision = hage::TimestampPrecision::Seconds };
+
+  hage::RotatingFileSink sink(config, std::make_unique<hage::SizeRotater>("test.log", 100));
+
+  // A directory where test.log.1 is moved to makes the rotations fail.
+  std::ofstream(dir.path / "test.log.1") << "old\n";
+  std::filesystem::create_directories(dir.path / "test.log.2" / "in_the_way");
+
+  const auto write = [&sink](const int from, const int to) {
+    int failures = 0;
+    for (int i = from; i < to; i++) {
+      try {
+        sink.receive(hage::LogLevel::Info, {}, fmt::format("line {:02}", i));
+      } catch (const std::filesystem::filesystem_error&) {
+        failures++;
+      }
+    }
+    while (true) {
+      try {
+        sink.flush();
+        return failures;
+      } catch (const std::filesystem::filesystem_error&) {
+        failures++;
+      }
+    }
+  };
+
+  REQUIRE_GT(write(0, 20), 0);
+
+  std::filesystem::remove_all(dir.path / "test.log.2");
+  REQUIRE_EQ(write(20, 29), 0);
+
+  // The files of the rotations that failed are left under the names they were prepared with, and the ones after are
+  // rotated as usual.
+  const auto first_line = [&dir](const std::string& name) {
+    std::ifstream in(dir.path / name);
+    std::string line;
+    std::getline(in, line);
+    return line.substr(line.size() - 2);
+  };
+  REQUIRE_EQ(first_line("test.log.2"), "22");
+  REQUIRE_EQ(first_line("test.log.1"), "25");
+  REQUIRE_EQ(first_line("test.log"), "28");
+}
+
+TEST_SUITE_END();
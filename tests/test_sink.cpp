@@ -4,4 +4,18 @@ void
 hage::test::TestSink::receive(hage::LogLevel level, const timestamp_type& ts, const std::string_view line)
 {
   m_stored.emplace_back(level, ts, std::string(line));
-}
\ No newline at end of file
+}
+
+void
+hage::test::TestSink::receive_batch(const std::span<const Record> records)
+{
+  m_batches.push_back(records.size());
+  for (const auto& record : records)
+    m_stored.emplace_back(record.level, record.ts, std::string(record.line), record.location);
+}
+
+void
+hage::test::TestSink::on_idle(const timestamp_type&)
+{
+  m_idleCalls.fetch_add(1, std::memory_order::relaxed);
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <deque>
+#include <vector>
 #include <hage/logging/sink.hpp>
 
 #include <doctest/doctest.h>
@@ -14,11 +16,27 @@ class TestSink final : public hage::Sink
 {
 public:
   void receive(hage::LogLevel level, const timestamp_type& ts, std::string_view line) override;
+  void receive_batch(std::span<const Record> records) override;
+  void on_idle(const timestamp_type& now) override;
 
   [[nodiscard]] bool empty() const { return m_stored.empty(); }
   [[nodiscard]] std::size_t size() const { return m_stored.size(); }
   void clear() { return m_stored.clear(); }
 
+  [[nodiscard]] timestamp_type front_timestamp() const { return m_stored.front().ts; }
+  [[nodiscard]] hage::SourceLocation front_location() const { return m_stored.front().location; }
+
+  // The number of times the consumer has told us it was idle. Can be read while the consumer runs.
+  [[nodiscard]] std::size_t idle_calls() const { return m_idleCalls.load(std::memory_order::relaxed); }
+
+  // The size of each batch received, in order.
+  [[nodiscard]] const std::vector<std::size_t>& batches() const { return m_batches; }
+
+  [[nodiscard]] bool front_is(const hage::LogLevel level, const std::string_view line) const
+  {
+    return !m_stored.empty() && m_stored.front().level == level && m_stored.front().line == line;
+  }
+
   void require_line(const hage::LogLevel level, const std::string_view line)
   {
     REQUIRE_UNARY_FALSE(m_stored.empty());
@@ -42,15 +60,22 @@ private:
     hage::LogLevel level;
     timestamp_type ts;
     std::string line;
+    hage::SourceLocation location;
 
-    Payload(const hage::LogLevel level, const timestamp_type ts, std::string line)
+    Payload(const hage::LogLevel level,
+            const timestamp_type ts,
+            std::string line,
+            const hage::SourceLocation location = {})
       : level{ level }
       , ts{ std::move(ts) }
       , line{ std::move(line) }
+      , location{ location }
     {
     }
   };
 
   std::deque<Payload> m_stored;
+  std::vector<std::size_t> m_batches;
+  std::atomic<std::size_t> m_idleCalls{ 0 };
 };
 } // namespace hage::test
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include <hage/logging/binary_file_sink.hpp>
+#include <hage/logging/console_sink.hpp>
+#include <hage/logging/file_sink.hpp>
+
+#include <fmt/core.h>
+
+#include <exception>
+
+// Turns a log written by a BinaryFileSink into text, written to a file or to stdout.
+int
+main(int argc, char** argv)
+{
+  if (argc < 2 || 3 < argc) {
+    fmt::print(stderr, "usage: {} <binary log> [output file]\n", argv[0]);
+    return 1;
+  }
+
+  try {
+    if (argc == 3) {
+      hage::FileSink sink(argv[2]);
+      hage::decode_binary_log(argv[1], sink);
+    } else {
+      hage::ConsoleSink sink;
+      hage::decode_binary_log(argv[1], sink);
+    }
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "{}\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}